@@ -0,0 +1,258 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "utils.h"
+#include "geomorphons.h"
+#include "bands.h"
+#include "profile.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define MAX_CPUS 1024
+
+/* Reads the list of CPUs of a NUMA node from sysfs (e.g. "0-15,32-47").
+   Returns the number of CPUs found, 0 if the node does not exist. */
+static int node_cpus(int node, int *cpus, int max){
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+  FILE *fp = fopen(path, "r");
+  if(fp == NULL)
+    return 0;
+
+  int n = 0, first, last, sep;
+  while(fscanf(fp, "%d", &first) == 1){
+    last = first;
+    sep = fgetc(fp);
+    if(sep == '-'){
+      if(fscanf(fp, "%d", &last) != 1)
+        break;
+      sep = fgetc(fp);
+    }
+    for(int c = first; c <= last && n < max; c++)
+      cpus[n++] = c;
+    if(sep != ',')
+      break;
+  }
+
+  fclose(fp);
+  return n;
+}
+
+/* Worker w runs on NUMA node w % nnodes. Workers sharing a node split its
+   CPUs, and the OpenMP team of the worker is sized to its share. Without
+   NUMA information the online CPUs are split in contiguous blocks. */
+static void pin_worker(int w, int nworkers){
+#ifdef __linux__
+  int cpus[MAX_CPUS];
+  int nnodes = 0, ncpus, share, slot;
+
+  while(node_cpus(nnodes, cpus, MAX_CPUS) > 0)
+    ++nnodes;
+
+  if(nnodes > 0){
+    int node = w % nnodes;
+    ncpus = node_cpus(node, cpus, MAX_CPUS);
+    share = nworkers / nnodes + (node < nworkers % nnodes);
+    slot = w / nnodes;
+  }
+  else{
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(ncpus > MAX_CPUS)
+      ncpus = MAX_CPUS;
+    for(int i = 0; i < ncpus; i++)
+      cpus[i] = i;
+    share = nworkers;
+    slot = w;
+  }
+
+  int per = ncpus / share;
+  if(per < 1)
+    per = 1;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int i = 0; i < per; i++)
+    CPU_SET(cpus[(slot * per + i) % ncpus], &set);
+
+  if(sched_setaffinity(0, sizeof(set), &set) != 0)
+    perror("sched_setaffinity");
+
+#ifdef _OPENMP
+  omp_set_num_threads(per);
+#endif
+#endif
+}
+
+/* Computes rows [r0, r1) of the DEM held in the shared segment, on skewed
+   copies of the band if skew is set. */
+static void band_worker(const GRID *dem, int *res, int radius, double cellsize, int r0, int r1, int skew){
+
+  int nrows = dem->nrows, ncols = dem->ncols;
+  int lo = r0 - radius < 0 ? 0 : r0 - radius;
+  int hi = r1 + radius > nrows ? nrows : r1 + radius;
+  int n = hi - lo;
+  size_t layer = (size_t)nrows * ncols;
+  size_t elsize = elem_size(dem->type);
+
+  /* The copy is the first touch of the local buffer, so its pages are
+     allocated on the node the worker is pinned to. */
+  void *local = malloc(elsize * n * ncols);
+  if(local == NULL){
+    printf("Not enough memory for the band of rows %d-%d.\n", lo, hi - 1);
+    fflush(stdout);
+    _exit(-1);
+  }
+  memcpy(local, (const char *) dem->data + elsize * lo * ncols, elsize * n * ncols);
+
+  GRID in = *dem;
+  in.data = local;
+  in.nrows = n;
+
+  /* Output rows point straight into the segment, which holds the nodata fill. */
+  int **band[3];
+  for(int a = 0; a < 3; a++){
+    band[a] = (int **) malloc(sizeof(int *) * n);
+    if(band[a] == NULL){
+      printf("Not enough memory for the band of rows %d-%d.\n", lo, hi - 1);
+      fflush(stdout);
+      _exit(-1);
+    }
+    for(int r = 0; r < n; r++)
+      band[a][r] = res + a * layer + (lo + r) * (size_t)ncols;
+  }
+
+  int rfirst = (r0 < 1 ? 1 : r0) - lo;
+  int rlast = (r1 > nrows - 1 ? nrows - 1 : r1) - lo;
+
+  SKEW *copies = NULL;
+  if(skew)
+    copies = skew_build(&in);  // NULL: scan the band without them
+
+  geomorphons_rows(&in, band, radius, cellsize, rfirst, rlast, copies);
+
+  skew_free(copies);
+
+  for(int a = 0; a < 3; a++)
+    free(band[a]);
+  free(local);
+}
+
+void geomorphons_bands(DATA *in, char **output, int radius, int noData, int nworkers, int skew){
+
+  int nrows = in->nrows, ncols = in->ncols;
+  if(nworkers > nrows)
+    nworkers = nrows;
+
+  PROF_ONLY(double t = prof_time();)
+
+  size_t layer = (size_t)nrows * ncols;
+  size_t demsize = (elem_size(in->type) * layer + 7) & ~(size_t)7;  // keeps the int layers aligned
+  size_t ressize = (layer * 3 * sizeof(int) + 7) & ~(size_t)7;  // keeps the profile slots aligned
+  size_t size = demsize + ressize;
+  PROF_ONLY(size += sizeof(PROFILE_DATA) * nworkers;)
+
+  char name[64];
+  snprintf(name, sizeof(name), "/geomorphons.%d", (int)getpid());
+
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if(fd < 0){
+    perror("shm_open");
+    exit(-1);
+  }
+
+  if(ftruncate(fd, size) != 0){
+    perror("ftruncate");
+    shm_unlink(name);
+    exit(-1);
+  }
+
+  void *seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  shm_unlink(name);  // the mapping stays valid in the parent and in the forked workers
+
+  if(seg == MAP_FAILED){
+    perror("mmap");
+    exit(-1);
+  }
+
+  /* The DEM is read straight into the segment, and the outputs are written
+     from it, so the parent holds no other copy of either. */
+  in->buffer = (void **) malloc(sizeof(void *));
+  in->buffer[0] = seg;
+  readRows(in, 0, nrows);
+
+  int *res = (int *) ((char *) seg + demsize);
+  for(size_t k = 0; k < 3 * layer; k++)
+    res[k] = noData;
+
+  GRID dem = dataGrid(in, seg, nrows, ncols);
+  double cellsize = in->adfGeoTransform[1];
+
+  PROF_ONLY(prof.read = prof_time() - t; t = prof_time();)
+
+  /* Decided once for all workers, on the largest band with its halo, as
+     the workers build their copies at the same time. */
+  int bandMax = (nrows + nworkers - 1) / nworkers + 2 * radius;
+  if(bandMax > nrows)
+    bandMax = nrows;
+  int copies = skew_policy(skew, bandMax, ncols, radius, elem_size(in->type), nworkers);
+
+  pid_t *pid = (pid_t *) malloc(sizeof(pid_t) * nworkers);
+
+  for(int w = 0; w < nworkers; w++){
+    int r0 = (int)((long)w * nrows / nworkers);
+    int r1 = (int)((long)(w + 1) * nrows / nworkers);
+
+    pid[w] = fork();
+    if(pid[w] < 0){
+      perror("fork");
+      exit(-1);
+    }
+    if(pid[w] == 0){
+      pin_worker(w, nworkers);
+      band_worker(&dem, res, radius, cellsize, r0, r1, copies);
+      PROF_ONLY(((PROFILE_DATA *) ((char *) res + ressize))[w] = prof;)
+      _exit(0);
+    }
+  }
+
+  int failed = 0;
+  for(int w = 0; w < nworkers; w++){
+    int status;
+    if(waitpid(pid[w], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed = 1;
+  }
+
+  if(failed){
+    printf("A band worker failed.\n");
+    exit(-1);
+  }
+
+  PROF_ONLY(for(int w = 0; w < nworkers; w++) prof_merge((PROFILE_DATA *) ((char *) res + ressize) + w);)
+  PROF_ONLY(prof.compute = prof_time() - t; t = prof_time();)
+
+  for(int a = 0; a < 3; a++){
+    GDALDatasetH hOut = createOutput(in->hDriver, output[a], nrows, ncols, noData, GDT_Int32, in->adfGeoTransform,
+        GDALGetProjectionRef(in->hDataset));
+    writeRows(hOut, res + a * layer, 0, nrows, ncols, GDT_Int32);
+    GDALClose(hOut);
+  }
+
+  PROF_ONLY(prof.write = prof_time() - t;)
+
+  munmap(seg, size);
+  free(in->buffer);
+  in->buffer = NULL;
+  free(pid);
+}
@@ -0,0 +1,13 @@
+/* Multi-process execution of geomorphons() on row bands of the DEM.
+ *
+ * The DEM is split into nworkers bands of rows. Each band is handled by a
+ * forked worker process pinned to the CPUs of one NUMA node. The DEM is read
+ * into a POSIX shared memory segment that also holds the three output
+ * layers, which are written to the output rasters from there; a worker copies
+ * its band plus a halo of radius rows into node-local memory, builds its own
+ * skewed copies if the skew policy asks for them, computes the band and
+ * writes the rows of the band back to the segment. The halo makes every
+ * worker copy 2 * radius rows more than its band, so the radius must be
+ * smaller than the height of a band. */
+
+void geomorphons_bands(DATA *, char **, int, int, int, int);  // input, outputs, radius, nodata, workers, skew mode
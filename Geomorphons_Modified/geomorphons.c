@@ -1,53 +1,106 @@
 #include "geomorphons.h"
+#include "profile.h"
+
+static const int pow3[8] = { 1, 3, 9, 27, 81, 243, 729, 2187 };
 
 void geomorphons(float **in, int ***out, int radius, double noData, double cellsize, int nrows, int ncols){
 
-  # pragma omp parallel for
-  for(int r = 1; r < nrows-1; r++){
-    for(int c = 1; c < ncols-1; c++){
-      if(in[r][c] != noData){
-        int ternary = 0, higher = 0, lower = 0;
-        float angle[8], max[8], phi[8], psi[8], min[8], diff[8], diff_c[8], bin[8];
-        for(int d = 0; d < 8; d++){
-          max[d] = -90, min[d] = 90, diff[d] = 0;
-          for(int a = 0; a <= radius; a++){  // function 1 with loop a
-            int r1 = a * nextr[d];
-            int c1 = a * nextc[d];
-            float d1 = sqrt(nextr[d] * nextr[d] + nextc[d] * nextc[d]);
-            if(r + r1 >= 0 && r + r1 < nrows && c + c1 >= 0 && c + c1 < ncols){
-              if(in[r+r1][c+c1] != noData){
-                diff_c[d] = in[r+r1][c+c1] - in[r][c];
-                if(fabsf(diff_c[d]) > diff[d]){
-                  angle[d] = atan(diff_c[d] /(a * d1 * cellsize)) * RAD2DEG;
-                  if(angle[d] >= max[d])
-                    max[d] = angle[d];
-                  if(angle[d] < min[d])
-                    min[d] = angle[d];
-                  diff[d] = fabsf(diff_c[d]);
-                }
-              }
-            }
-          }
-
-          phi[d] = 90 - max[d];
-          psi[d] = 90 + min[d];
-          bin[d] = binary(psi[d] - phi[d]);
-          int power = 7 - d;
-          ternary += bin[d] * pow(3, power);
-
-          if(bin[d] == 2)
-            ++higher;   // number of higher neighborhood directions
-          else if(bin[d] == 0)
-            ++lower;   // number of lower neighborhood directions
-        }
-
-        out[0][r][c] = ternary_rotate(ternary);
-        out[1][r][c] = higher;
-        out[2][r][c] = lower;
-
-      }
-    }
-  }
+  GRID g = { in[0], ELEM_FLOAT32, isnan(noData) ? NODATA_NAN : NODATA_SENTINEL, noData, nrows, ncols };
+
+  geomorphons_rows(&g, out, radius, cellsize, 1, nrows-1, NULL);
+}
+
+/* Number of steps of direction d from (r, c) that stay inside the buffer. */
+static inline int scan_length(int r, int c, int d, int nrows, int ncols, int radius){
+  int n = radius;
+
+  if(nextr[d] < 0 && r < n)
+    n = r;
+  if(nextr[d] > 0 && nrows - 1 - r < n)
+    n = nrows - 1 - r;
+  if(nextc[d] < 0 && c < n)
+    n = c;
+  if(nextc[d] > 0 && ncols - 1 - c < n)
+    n = ncols - 1 - c;
+
+  return n;
+}
+
+#define ELEM float
+#define REAL float
+#define POLICY NODATA_NONE
+#define NAME kernel_float32_none
+#include "geomorphons_kernel.h"
+
+#define ELEM float
+#define REAL float
+#define POLICY NODATA_SENTINEL
+#define NAME kernel_float32_sentinel
+#include "geomorphons_kernel.h"
+
+#define ELEM float
+#define REAL float
+#define POLICY NODATA_NAN
+#define NAME kernel_float32_nan
+#include "geomorphons_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_NONE
+#define NAME kernel_float64_none
+#include "geomorphons_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_SENTINEL
+#define NAME kernel_float64_sentinel
+#include "geomorphons_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_NAN
+#define NAME kernel_float64_nan
+#include "geomorphons_kernel.h"
+
+#define ELEM int16_t
+#define REAL float
+#define POLICY NODATA_NONE
+#define NAME kernel_int16_none
+#include "geomorphons_kernel.h"
+
+#define ELEM int16_t
+#define REAL float
+#define POLICY NODATA_SENTINEL
+#define NAME kernel_int16_sentinel
+#include "geomorphons_kernel.h"
+
+typedef void (*KERNEL)(const GRID *, int ***, int, double, int, int, int, int, const SKEW *);
+
+/* [element type][nodata policy]; an int16 DEM cannot hold NaN */
+static const KERNEL kernels[3][3] = {
+  { kernel_float32_none, kernel_float32_sentinel, kernel_float32_nan },
+  { kernel_float64_none, kernel_float64_sentinel, kernel_float64_nan },
+  { kernel_int16_none, kernel_int16_sentinel, kernel_int16_none }
+};
+
+/* Computes rows [rfirst, rlast) of the grid. Rows outside this range are
+   only read, so a band of a larger DEM can be processed on its own as long
+   as the grid holds radius rows of halo above and below the band.
+   skew may be NULL; otherwise it holds the copies built from the grid. */
+void geomorphons_rows(const GRID *g, int ***out, int radius, double cellsize, int rfirst, int rlast, const SKEW *skew){
+
+  geomorphons_window(g, out, radius, cellsize, rfirst, rlast, 1, g->ncols-1, skew);
+}
+
+/* As geomorphons_rows(), restricted to columns [cfirst, clast). Only the
+   rows [rfirst, rlast) of out are written. */
+void geomorphons_window(const GRID *g, int ***out, int radius, double cellsize, int rfirst, int rlast,
+    int cfirst, int clast, const SKEW *skew){
+
+  PROF_ONLY(int nthreads = prof_threads() < PROF_MAX_THREADS ? prof_threads() : PROF_MAX_THREADS;)
+  PROF_ONLY(if(prof.nthreads < nthreads) prof.nthreads = nthreads;)
+
+  kernels[g->type][g->policy](g, out, radius, cellsize, rfirst, rlast, cfirst, clast, skew);
 }
 
 int binary(float diff){
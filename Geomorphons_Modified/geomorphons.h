@@ -1,5 +1,7 @@
 #include <math.h>
 #include <stdlib.h>
+#include "grid.h"
+#include "skew.h"
 
 #define RAD2DEG 57.29578
 
@@ -11,8 +13,19 @@
 static int nextr[8] = { -1, -1, -1, 0, 1, 1, 1, 0 };
 static int nextc[8] = { 1, 0, -1, -1, -1, 0, 1, 1 };
 
+/* The rows of the input buffer must be contiguous: in[r] == in[0] + r * ncols. */
+
 void geomorphons(float**, int***, int, double, double, int, int);
 
+/* The kernel for the element type and nodata policy of the grid is chosen
+   at run time; see geomorphons_kernel.h. The cellsize arguments are kept
+   for the callers but ignored: the classification compares slopes along
+   one direction, which all share the cell size. */
+
+void geomorphons_rows(const GRID *, int***, int, double, int, int, const SKEW *);  // radius, cellsize, rows
+
+void geomorphons_window(const GRID *, int***, int, double, int, int, int, int, const SKEW *);  // ..., rows, cols
+
 int binary(float);
 
 unsigned int ternary_rotate(unsigned int);
@@ -0,0 +1,162 @@
+/* Template of the geomorphons() kernel.
+ *
+ * geomorphons.c includes this file once per instantiation, with
+ *   ELEM    element type of the DEM
+ *   REAL    type of the elevation differences: float, or double for double DEMs
+ *   POLICY  NODATA_NONE, NODATA_SENTINEL or NODATA_NAN
+ *   NAME    name of the generated kernel
+ * The nodata test and the arithmetic are fixed at compile time, and cells
+ * whose scan lines all stay inside the buffer (interior) are computed by a
+ * copy of the cell without the scan length clipping.
+ *
+ * The zenith and nadir angles of a direction only enter through the sign of
+ * psi - phi = max + min, and atan is odd and monotonic, so the horizon is
+ * tracked on the slope diff_c / a instead: the step length of the direction
+ * and the cell size are common to all its samples and drop out. The slopes
+ * are kept in double, where equal ratios of the integer valued differences
+ * and steps round to the same value, so a tie (bin 1) does not depend on
+ * the element type or on rounding in atan. */
+
+#define TPL_CAT2(a, b) a##_##b
+#define TPL_CAT(a, b) TPL_CAT2(a, b)
+#define TPL(x) TPL_CAT(NAME, x)
+
+#if POLICY == NODATA_NONE
+#define IS_DATA(z) 1
+#elif POLICY == NODATA_SENTINEL
+#define IS_DATA(z) ((z) != noData)
+#else
+#define IS_DATA(z) ((z) == (z))
+#endif
+
+/* Start of the scan line of direction d through (r, c), and its stride.
+   With skewed copies every direction but the horizontal ones is read at
+   unit stride from its own copy. */
+static inline const ELEM *TPL(scan_line)(const ELEM *in, const SKEW *skew, int r, int c, int d, int ncols,
+    ptrdiff_t *step){
+
+  if(skew != NULL){
+    int k, r0;
+    switch(d){
+      case 1: case 5:
+        *step = nextr[d];
+        return (const ELEM *) skew->t + (size_t)c * skew->nrows + r;
+      case 2: case 6:
+        k = c - r + skew->nrows - 1;
+        r0 = skew->nrows - 1 - k > 0 ? skew->nrows - 1 - k : 0;
+        *step = nextr[d];
+        return (const ELEM *) skew->diag + skew->diagOff[k] + (r - r0);
+      case 0: case 4:
+        k = r + c;
+        r0 = k - skew->ncols + 1 > 0 ? k - skew->ncols + 1 : 0;
+        *step = nextr[d];
+        return (const ELEM *) skew->anti + skew->antiOff[k] + (r - r0);
+    }
+  }
+
+  *step = (ptrdiff_t)nextr[d] * ncols + nextc[d];
+  return in + (size_t)r * ncols + c;
+}
+
+/* interior is a constant at every call, so each call site keeps only its
+   own variant of the scan length. */
+static inline void TPL(cell)(const ELEM *in, int ***out, int radius, ELEM noData,
+    int nrows, int ncols, int r, int c, const SKEW *skew, const int interior, COUNTERS *cnt){
+
+  ELEM centre = in[(size_t)r * ncols + c];
+  if(!IS_DATA(centre)){
+    PROF_ONLY(++cnt->nodata;)
+    return;
+  }
+
+  int ternary = 0, higher = 0, lower = 0;
+  PROF_ONLY(++cnt->cells;)
+
+  for(int d = 0; d < 8; d++){
+    double max = 0, min = 0;  // steepest and lowest slope, valid once diff > 0
+    REAL diff = 0;
+    ptrdiff_t step;
+    const ELEM *line = TPL(scan_line)(in, skew, r, c, d, ncols, &step);
+    int length = interior ? radius : scan_length(r, c, d, nrows, ncols, radius);
+    PROF_ONLY(int reach = 0; cnt->samples[d] += length;)
+
+    for(int a = 1; a <= length; a++){  // function 1 with loop a; the centre (a = 0) never moves the horizon
+      ELEM z = line[a * step];
+      if(IS_DATA(z)){
+        REAL diff_c = (REAL)z - (REAL)centre;
+        REAL abs_c = diff_c < 0 ? -diff_c : diff_c;
+        if(abs_c > diff){
+          double slope = (double)diff_c / a;
+          if(diff == 0 || slope >= max)
+            max = slope;
+          if(diff == 0 || slope < min)
+            min = slope;
+          diff = abs_c;
+          PROF_ONLY(++cnt->updates; reach = a;)
+        }
+      }
+      PROF_ONLY(else ++cnt->nodataSamples;)
+    }
+    PROF_ONLY(cnt->reach[d] += reach;)
+
+    /* psi - phi of binary(); without a sample both angles stay at 90 */
+    double sum = max + min;
+    int bin = diff == 0 || sum == 0 ? 1 : sum > 0 ? 2 : 0;
+    ternary += bin * pow3[7 - d];
+
+    if(bin == 2)
+      ++higher;   // number of higher neighborhood directions
+    else if(bin == 0)
+      ++lower;   // number of lower neighborhood directions
+  }
+
+  out[0][r][c] = ternary_rotate(ternary);
+  out[1][r][c] = higher;
+  out[2][r][c] = lower;
+}
+
+static void NAME(const GRID *g, int ***out, int radius, double cellsize, int rfirst, int rlast, int cfirst, int clast,
+    const SKEW *skew){
+
+  const ELEM *in = (const ELEM *) g->data;
+  int nrows = g->nrows, ncols = g->ncols;
+  ELEM noData = POLICY == NODATA_SENTINEL ? (ELEM) g->noData : 0;
+
+  (void) cellsize;  // the classification is invariant to it, see above
+
+  /* columns [ci0, ci1) are interior on rows that are interior */
+  int ci0 = radius > cfirst ? radius : cfirst;
+  int ci1 = ncols - radius < clast ? ncols - radius : clast;
+  if(ci0 > clast)
+    ci0 = clast;
+  if(ci1 < ci0)
+    ci1 = ci0;
+
+  # pragma omp parallel for
+  for(int r = rfirst; r < rlast; r++){
+    COUNTERS cnt;
+    PROF_ONLY(cnt = (COUNTERS){0};)
+
+    int lo = ci0, hi = ci1;
+    if(r < radius || r + radius >= nrows)
+      lo = hi = clast;
+
+    for(int c = cfirst; c < lo; c++)
+      TPL(cell)(in, out, radius, noData, nrows, ncols, r, c, skew, 0, &cnt);
+    for(int c = lo; c < hi; c++)
+      TPL(cell)(in, out, radius, noData, nrows, ncols, r, c, skew, 1, &cnt);
+    for(int c = hi; c < clast; c++)
+      TPL(cell)(in, out, radius, noData, nrows, ncols, r, c, skew, 0, &cnt);
+
+    PROF_ONLY(prof_flush(&cnt);)
+  }
+}
+
+#undef IS_DATA
+#undef TPL
+#undef TPL_CAT
+#undef TPL_CAT2
+#undef ELEM
+#undef REAL
+#undef POLICY
+#undef NAME
@@ -0,0 +1,35 @@
+/* A DEM buffer as seen by the kernels: one block of nrows * ncols elements
+ * in row-major order, in the element type of the dataset, together with the
+ * way nodata cells are marked. geomorphons.c instantiates one kernel per
+ * element type and nodata policy and picks it from these fields. */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* element types */
+#define ELEM_FLOAT32 0
+#define ELEM_FLOAT64 1
+#define ELEM_INT16   2
+
+/* nodata policies */
+#define NODATA_NONE     0   // every cell holds data
+#define NODATA_SENTINEL 1   // cells equal to noData
+#define NODATA_NAN      2   // NaN cells (floating point types only)
+
+typedef struct {
+  const void *data;
+  int type;
+  int policy;
+  double noData;
+  int nrows;
+  int ncols;
+} GRID;
+
+static inline size_t elem_size(int type){
+  return type == ELEM_FLOAT64 ? sizeof(double) : type == ELEM_INT16 ? sizeof(int16_t) : sizeof(float);
+}
+
+#endif
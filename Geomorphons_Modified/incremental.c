@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include "utils.h"
+#include "geomorphons.h"
+#include "incremental.h"
+#include "profile.h"
+
+static void append(WINDOW **w, int *n, int *cap, WINDOW v){
+  if(*n == *cap){
+    *cap *= 2;
+    *w = (WINDOW *) realloc(*w, sizeof(WINDOW) * *cap);
+  }
+  (*w)[(*n)++] = v;
+}
+
+int readDirtyList(char *file, WINDOW **list){
+  FILE *fp = fopen(file, "r");
+  if(fp == NULL){
+    printf("Cannot open %s.\n", file);
+    exit(-1);
+  }
+
+  int n = 0, cap = 16;
+  WINDOW *w = (WINDOW *) malloc(sizeof(WINDOW) * cap);
+  char line[256];
+
+  while(fgets(line, sizeof(line), fp) != NULL){
+    WINDOW v;
+    if(line[0] == '#' || sscanf(line, "%d %d %d %d", &v.x0, &v.y0, &v.nx, &v.ny) != 4)
+      continue;
+    append(&w, &n, &cap, v);
+  }
+
+  fclose(fp);
+  *list = w;
+  return n;
+}
+
+/* Each band of MASK_BAND rows of the mask becomes the bounding box of its
+   edited cells. The mask must have the size of the DEM. */
+int readDirtyMask(char *file, int demRows, int demCols, WINDOW **list){
+  GDALDatasetH hDataset = GDALOpen(file, GA_ReadOnly);
+  if(hDataset == NULL){
+    printf("Cannot open %s: %s\n", file, CPLGetLastErrorMsg());
+    exit(-1);
+  }
+
+  GDALRasterBandH hBand = GDALGetRasterBand(hDataset, 1);
+  int ncols = GDALGetRasterBandXSize(hBand);
+  int nrows = GDALGetRasterBandYSize(hBand);
+  if(nrows != demRows || ncols != demCols){
+    printf("%s has %d x %d cells, the DEM %d x %d.\n", file, nrows, ncols, demRows, demCols);
+    exit(-1);
+  }
+
+  int n = 0, cap = 16;
+  WINDOW *w = (WINDOW *) malloc(sizeof(WINDOW) * cap);
+  float *row = (float *) malloc(sizeof(float) * ncols);
+
+  for(int r0 = 0; r0 < nrows; r0 += MASK_BAND){
+    int r1 = r0 + MASK_BAND < nrows ? r0 + MASK_BAND : nrows;
+    int cmin = ncols, cmax = -1, rmin = nrows, rmax = -1;
+
+    for(int r = r0; r < r1; r++){
+      if(GDALRasterIO(hBand, GF_Read, 0, r, ncols, 1, row, ncols, 1, GDT_Float32, 0, 0) != CE_None){
+        printf("Reading row %d of %s failed: %s\n", r, file, CPLGetLastErrorMsg());
+        exit(-1);
+      }
+      for(int c = 0; c < ncols; c++){
+        if(row[c] != 0){
+          if(c < cmin) cmin = c;
+          if(c > cmax) cmax = c;
+          if(r < rmin) rmin = r;
+          rmax = r;
+        }
+      }
+    }
+
+    if(cmax >= 0){
+      WINDOW v = { cmin, rmin, cmax - cmin + 1, rmax - rmin + 1 };
+      append(&w, &n, &cap, v);
+    }
+  }
+
+  free(row);
+  GDALClose(hDataset);
+  *list = w;
+  return n;
+}
+
+static int by_row(const void *a, const void *b){
+  return *(const int *) a - *(const int *) b;
+}
+
+static int by_col(const void *a, const void *b){
+  return ((const WINDOW *) a)->x0 - ((const WINDOW *) b)->x0;
+}
+
+/* Splits the union of the windows into disjoint windows: the rows are cut at
+   every top and bottom edge, the windows covering each strip are merged
+   into runs of columns, and a run that continues one of the strip above
+   with the same columns extends it. */
+static int disjoint(WINDOW *w, int n, WINDOW **list){
+  int *cut = (int *) malloc(sizeof(int) * 2 * (n + 1));
+  WINDOW *run = (WINDOW *) malloc(sizeof(WINDOW) * (n + 1));
+  int ncut = 0;
+  for(int i = 0; i < n; i++){
+    cut[ncut++] = w[i].y0;
+    cut[ncut++] = w[i].y0 + w[i].ny;
+  }
+  qsort(cut, ncut, sizeof(int), by_row);
+
+  int m = 0, cap = 16;
+  WINDOW *d = (WINDOW *) malloc(sizeof(WINDOW) * cap);
+
+  for(int k = 0; k + 1 < ncut; k++){
+    int y0 = cut[k], y1 = cut[k+1];
+    if(y0 == y1)
+      continue;
+
+    int nrun = 0;
+    for(int i = 0; i < n; i++)
+      if(w[i].y0 <= y0 && w[i].y0 + w[i].ny >= y1)
+        run[nrun++] = w[i];
+    qsort(run, nrun, sizeof(WINDOW), by_col);
+
+    int first = m;
+    for(int i = 0; i < nrun; ){
+      int x0 = run[i].x0, x1 = run[i].x0 + run[i].nx;
+      for(++i; i < nrun && run[i].x0 <= x1; i++)
+        if(run[i].x0 + run[i].nx > x1)
+          x1 = run[i].x0 + run[i].nx;
+
+      int j;
+      for(j = 0; j < first; j++)
+        if(d[j].y0 + d[j].ny == y0 && d[j].x0 == x0 && d[j].nx == x1 - x0)
+          break;
+      if(j < first)
+        d[j].ny += y1 - y0;
+      else{
+        WINDOW v = { x0, y0, x1 - x0, y1 - y0 };
+        append(&d, &m, &cap, v);
+      }
+    }
+  }
+
+  free(cut); free(run);
+  *list = d;
+  return m;
+}
+
+void geomorphons_update(DATA *in, char **output, int radius, int noData, WINDOW *edit, int nedit){
+
+  int nrows = in->nrows, ncols = in->ncols;
+  GDALDatasetH hOut[3];
+
+  for(int a = 0; a < 3; a++){
+    hOut[a] = GDALOpen(output[a], GA_Update);
+    if(hOut[a] == NULL){
+      printf("Cannot open %s for update: %s\n", output[a], CPLGetLastErrorMsg());
+      exit(-1);
+    }
+    if(GDALGetRasterXSize(hOut[a]) != ncols || GDALGetRasterYSize(hOut[a]) != nrows){
+      printf("%s does not match the size of the DEM.\n", output[a]);
+      exit(-1);
+    }
+  }
+
+  /* cells whose scan lines can reach an edited window; the dilated windows
+     overlap, so each cell of their union is computed once */
+  int n = 0;
+  WINDOW *grown = (WINDOW *) malloc(sizeof(WINDOW) * (nedit + 1)), *w;
+  for(int i = 0; i < nedit; i++){
+    int r0 = edit[i].y0 - radius > 1 ? edit[i].y0 - radius : 1;
+    int r1 = edit[i].y0 + edit[i].ny + radius < nrows - 1 ? edit[i].y0 + edit[i].ny + radius : nrows - 1;
+    int c0 = edit[i].x0 - radius > 1 ? edit[i].x0 - radius : 1;
+    int c1 = edit[i].x0 + edit[i].nx + radius < ncols - 1 ? edit[i].x0 + edit[i].nx + radius : ncols - 1;
+    if(edit[i].nx <= 0 || edit[i].ny <= 0 || r0 >= r1 || c0 >= c1)
+      continue;
+    WINDOW v = { c0, r0, c1 - c0, r1 - r0 };
+    grown[n++] = v;
+  }
+  n = disjoint(grown, n, &w);
+  free(grown);
+
+  long long cells = 0;
+
+  for(int i = 0; i < n; i++){
+    int r0 = w[i].y0, r1 = w[i].y0 + w[i].ny;
+    int c0 = w[i].x0, c1 = w[i].x0 + w[i].nx;
+
+    /* the DEM under their scan lines */
+    int lr0 = r0 - radius > 0 ? r0 - radius : 0;
+    int lr1 = r1 + radius < nrows ? r1 + radius : nrows;
+    int lc0 = c0 - radius > 0 ? c0 - radius : 0;
+    int lc1 = c1 + radius < ncols ? c1 + radius : ncols;
+    int lrows = lr1 - lr0, lcols = lc1 - lc0;
+
+    size_t layer = (size_t)(r1 - r0) * lcols;
+    void *block = malloc(elem_size(in->type) * lrows * lcols);
+    int *res = (int *) malloc(sizeof(int) * 3 * layer);
+    int **out[3];
+    int ok = block != NULL && res != NULL;
+    for(int a = 0; a < 3; a++){
+      out[a] = (int **) malloc(sizeof(int *) * lrows);
+      ok = ok && out[a] != NULL;
+    }
+    if(!ok){
+      printf("Not enough memory for an update window.\n");
+      exit(-1);
+    }
+
+    PROF_ONLY(double t = prof_time();)
+
+    readWindow(in, block, lc0, lr0, lcols, lrows);
+    GRID dem = dataGrid(in, block, lrows, lcols);
+
+    PROF_ONLY(prof.read += prof_time() - t; t = prof_time();)
+
+    for(size_t k = 0; k < 3 * layer; k++)
+      res[k] = noData;
+
+    for(int a = 0; a < 3; a++){
+      for(int r = r0; r < r1; r++)
+        out[a][r - lr0] = res + a * layer + (size_t)(r - r0) * lcols;
+    }
+
+    geomorphons_window(&dem, out, radius, in->adfGeoTransform[1], r0 - lr0, r1 - lr0, c0 - lc0, c1 - lc0, NULL);
+
+    PROF_ONLY(prof.compute += prof_time() - t; t = prof_time();)
+
+    for(int a = 0; a < 3; a++){
+      writeWindow(hOut[a], res + a * layer + (c0 - lc0), c0, r0, c1 - c0, r1 - r0, lcols, GDT_Int32);
+      free(out[a]);
+    }
+
+    PROF_ONLY(prof.write += prof_time() - t;)
+
+    cells += (long long)(r1 - r0) * (c1 - c0);
+
+    free(res); free(block);
+  }
+
+  printf("Recomputed %lld of %lld cells in %d windows.\n", cells, (long long)nrows * ncols, n);
+  free(w);
+
+  for(int a = 0; a < 3; a++)
+    GDALClose(hOut[a]);
+}
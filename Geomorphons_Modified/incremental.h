@@ -0,0 +1,22 @@
+/* Incremental update of existing outputs after the DEM has been edited.
+ *
+ * The edited cells are given as a list of windows or as a mask raster. A
+ * cell can only change if one of its scan lines crosses an edited cell, so
+ * each window is dilated by the scan radius. The union of the dilated windows
+ * is split into disjoint windows; the DEM is read for each of them plus a
+ * halo of radius cells, and only the window itself is recomputed and written
+ * into the existing outputs. The radius must be the
+ * one the outputs were computed with. */
+
+typedef struct {
+  int x0, y0;    // first column and row
+  int nx, ny;    // number of columns and rows
+} WINDOW;
+
+#define MASK_BAND 64  // rows of the mask summarised by one window
+
+int readDirtyList(char *, WINDOW **);  // text file, one "xoff yoff xsize ysize" per line
+
+int readDirtyMask(char *, int, int, WINDOW **);  // raster of the DEM's rows and cols, non-zero cells are edited
+
+void geomorphons_update(DATA *, char **, int, int, WINDOW *, int);  // input, outputs, radius, nodata, windows
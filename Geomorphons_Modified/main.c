@@ -14,6 +14,17 @@
             the central pixel and the pixel lying at a distance equal to the
             scan radius) reaches its maximum value.
 
+            Difference from the published version: a direction whose zenith
+            and nadir angles are equal is now always classified as flat
+            (ternary digit 1). The published version compared the angles
+            after rounding them to float, which turned some of these ties
+            into higher or lower directions. Ties are common on integer
+            valued DEMs; on those, a small share of the ternary, higher
+            and lower values differs from the published version (207 of
+            120,000 cells on a smooth DEM, a few percent on noisy ones).
+            The results on DEMs with fractional elevations are unchanged
+            in practice.
+
             This program is free software: you can redistribute it and/or modify
             it under the terms of the GNU General Public License as published
             by the Free Software Foundation, either version 3 of the License, or
@@ -31,58 +42,227 @@
 
             Compilation: make
 
-            Execution: ./geomorphons_modified <input> <output1> <output2> <output3>
+            Execution: ./geomorphons_modified [-r radius] [-p processes | -b rows] [-s on|off|auto]
+                                              [-u regions.txt | -m mask] [-j report.json]
+                                              <input> <output1> <output2> <output3>
+                       ./geomorphons_modified -r radius -q queries.txt|- [-f csv|json] <input>
 
-            input: a raster Digital Elevation Model (DEM) file
+            input: a raster Digital Elevation Model (DEM) file; Float64, Int16
+                   and Byte DEMs are kept in their own type, others are read
+                   as Float32. Without a nodata value every cell is data.
             output1: ternary
             output2: number of higher neighborhood directions
             output3: number of lower neighborhood directions
+            -r: maximum scan radius in cells (default: the whole DEM)
+            -p: number of worker processes; the DEM is split into row bands,
+                one per process, each pinned to a NUMA node. Requires -r,
+                since each band carries a halo of radius rows; the radius
+                must be smaller than the height of a band.
+            -s: scan vertical and diagonal directions on transposed and skewed
+                copies of the DEM (3 extra copies); auto (default) builds them
+                when the radius is long and enough memory is available
+            -b: pipelined I/O; a reader thread reads the DEM in bands of this
+                many rows and a writer thread writes finished bands while the
+                next ones are computed. Output is kept in a small ring of
+                bands instead of three full rasters, and input in a ring of
+                2 * (rows + radius) rows. Requires -r, which bounds the halo a
+                band waits for. Skewed copies are not built in this mode;
+                not combined with -p or -s.
+            -u: update existing outputs after an edit of the DEM; the file
+                lists the edited windows, one "xoff yoff xsize ysize" (in
+                cells) per line. Only cells within radius of an edited
+                window are recomputed, so use the -r of the original run.
+                Not combined with -p, -b or -s.
+            -m: as -u, with the edited cells given as the non-zero cells of
+                a mask raster of the size of the DEM
+            -j: write phase timings, I/O throughput and kernel counters as
+                JSON (only when compiled with make CFLAGS=-DPROFILE)
+            -q: query mode, no output rasters; answers the queries of the
+                file (- for stdin, one process serving many queries) with
+                the geomorphon and the Evans-Young parameters of each cell:
+                  point X Y | bbox XMIN YMIN XMAX YMAX | window XOFF YOFF XSIZE YSIZE
+                Only the queried cells plus a halo of radius cells are read,
+                through a cache of DEM tiles (see query.h). Requires -r, so
+                that the halo stays within a few tiles. Cells without a
+                value hold -9999, as in the output rasters. Only -r and -f
+                apply to this mode.
+            -f: format of the answers of -q, csv (default) or json
 
             example: ./geomorphons_modified DEM.bil ternary.bil higher.bil lower.bil
+            example: ./geomorphons_modified -r 50 -p 2 DEM.bil ternary.bil higher.bil lower.bil
+            example: ./geomorphons_modified -r 50 -b 256 DEM.bil ternary.bil higher.bil lower.bil
+            example: ./geomorphons_modified -r 50 -u edits.txt DEM.bil ternary.bil higher.bil lower.bil
+            example: echo "point 512340 4201870" | ./geomorphons_modified -r 50 -q - -f json DEM.bil
 */
 
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "utils.h"
 #include "geomorphons.h"
+#include "bands.h"
+#include "pipeline.h"
+#include "incremental.h"
+#include "query.h"
+#include "profile.h"
 
 int main(int argc, char **argv){
 
-  char *input = argv[1];  // Input filename
+  int radius = 0;     // 0: scan the whole DEM
+  int processes = 1;
+  int skew = SKEW_AUTO;
+  int skewGiven = 0;
+  int bandRows = 0;   // 0: read, compute and write one after the other
+  char *dirtyList = NULL, *dirtyMask = NULL;
+  char *report = NULL;
+  char *queries = NULL;
+  int format = QUERY_CSV;
+  int opt;
+
+  while((opt = getopt(argc, argv, "r:p:s:b:u:m:j:q:f:")) != -1){
+    switch(opt){
+      case 'r': radius = atoi(optarg); break;
+      case 'p': processes = atoi(optarg); break;
+      case 'b': bandRows = atoi(optarg); break;
+      case 'u': dirtyList = optarg; break;
+      case 'm': dirtyMask = optarg; break;
+      case 's': skewGiven = 1;
+                skew = strcmp(optarg, "on") == 0 ? SKEW_ON : strcmp(optarg, "off") == 0 ? SKEW_OFF :
+                       strcmp(optarg, "auto") == 0 ? SKEW_AUTO : -1; break;
+      case 'j': report = optarg; break;
+      case 'q': queries = optarg; break;
+      case 'f': format = strcmp(optarg, "csv") == 0 ? QUERY_CSV : strcmp(optarg, "json") == 0 ? QUERY_JSON : -1; break;
+      default: argc = 0;
+    }
+  }
+
+  if(argc - optind != (queries != NULL ? 1 : 4) || format < 0 || radius < 0 || processes < 1 || skew < 0 || bandRows < 0 || (bandRows > 0 && processes > 1)
+      || (processes > 1 && radius == 0) || (bandRows > 0 && radius == 0) || (queries != NULL && radius == 0) || (dirtyList != NULL && dirtyMask != NULL)
+      || ((dirtyList != NULL || dirtyMask != NULL) && (processes > 1 || bandRows > 0 || skewGiven))
+      || (queries != NULL && (processes > 1 || bandRows > 0 || skewGiven || dirtyList != NULL || dirtyMask != NULL
+                              || report != NULL))
+      || (bandRows > 0 && skewGiven)){
+    printf("Usage: %s [-r radius] [-p processes | -b rows] [-s on|off|auto] [-u regions.txt | -m mask] [-j report.json]"
+        " <input> <output1> <output2> <output3>\n", argv[0]);
+    printf("       %s -r radius -q queries.txt|- [-f csv|json] <input>\n", argv[0]);
+    exit(-1);
+  }
+
+  char *input = argv[optind];  // Input filename
+
+  if(queries != NULL){
+    DATA in = openRaster(input);
+
+    int maxRadius = in.nrows > in.ncols ? in.nrows : in.ncols;
+    if(radius > maxRadius)
+      radius = maxRadius;
+
+    FILE *fp = strcmp(queries, "-") == 0 ? stdin : fopen(queries, "r");
+    if(fp == NULL){
+      printf("Cannot open %s.\n", queries);
+      exit(-1);
+    }
+
+    QUERY q;
+    query_init(&q, &in, radius, -9999);
+    query_loop(&q, fp, format);
+    query_free(&q);
+
+    if(fp != stdin)
+      fclose(fp);
+    GDALClose(in.hDataset);
+    return 0;
+  }
 
   // Output filename
   char *output[3];
 
-  output[0] = argv[2];
-  output[1] = argv[3];
-  output[2] = argv[4];
+  output[0] = argv[optind+1];
+  output[1] = argv[optind+2];
+  output[2] = argv[optind+3];
+
+#ifndef PROFILE
+  if(report != NULL)
+    printf("Built without -DPROFILE, no report is written.\n");
+#endif
+
+  PROF_ONLY(double t0 = prof_time(), t = t0;)
 
   DATA in;
-  in = readRaster(input);
+  in = openRaster(input);
 
-  int radius = in.nrows > in.ncols ? in.nrows : in.ncols;
+  int maxRadius = in.nrows > in.ncols ? in.nrows : in.ncols;
+  if(radius == 0 || radius > maxRadius)
+    radius = maxRadius;
 
   int noData = -9999;
-  int ***outbuffer = malloc3Dmatrix(3, in.nrows, in.ncols, noData);
 
-  geomorphons(in.buffer[0], outbuffer, radius, in.noData[0], in.adfGeoTransform[1], in.nrows, in.ncols);
+  if(dirtyList != NULL || dirtyMask != NULL){
+    WINDOW *dirty;
+    int ndirty = dirtyList != NULL ? readDirtyList(dirtyList, &dirty) : readDirtyMask(dirtyMask, in.nrows, in.ncols, &dirty);
+
+    geomorphons_update(&in, output, radius, noData, dirty, ndirty);
+
+    free(dirty);
+  }
+  else if(bandRows > 0)
+    geomorphons_pipeline(&in, output, radius, noData, bandRows);
+  else if(processes > 1){
+    if(radius >= in.nrows / processes){
+      printf("With -p %d the radius must be smaller than the band height of %d rows.\n", processes,
+          in.nrows / processes);
+      exit(-1);
+    }
+    geomorphons_bands(&in, output, radius, noData, processes, skew);
+  }
+  else{
+    allocRaster(&in);
+    readRows(&in, 0, in.nrows);
+
+    PROF_ONLY(prof.read = prof_time() - t; t = prof_time();)
+
+    int ***outbuffer = malloc3Dmatrix(3, in.nrows, in.ncols, noData);
+    GRID dem = dataGrid(&in, in.buffer[0], in.nrows, in.ncols);
 
-  // create output files
-  for(int a = 0; a < 3; a++)
-    writeOutput(in.hDriver, output[a], outbuffer[a], in.nrows, in.ncols, noData,
-        GDT_Int32, in.adfGeoTransform, GDALGetProjectionRef(in.hDataset));
+    SKEW *copies = NULL;
+    if(skew_policy(skew, in.nrows, in.ncols, radius, elem_size(in.type), 1)){
+      copies = skew_build(&dem);
+      if(copies == NULL)
+        printf("Not enough memory for the skewed copies, scanning without them.\n");
+    }
+
+    geomorphons_rows(&dem, outbuffer, radius, in.adfGeoTransform[1], 1, in.nrows-1, copies);
+
+    skew_free(copies);
+
+    PROF_ONLY(prof.compute = prof_time() - t; t = prof_time();)
+
+    // create output files
+    for(int a = 0; a < 3; a++)
+      writeOutput(in.hDriver, output[a], outbuffer[a], in.nrows, in.ncols, noData,
+          GDT_Int32, in.adfGeoTransform, GDALGetProjectionRef(in.hDataset));
+
+    PROF_ONLY(prof.write = prof_time() - t;)
+
+    for(int a = 0; a < 3; a++){
+      for(int r = 0; r < in.nrows; r++)
+        free(outbuffer[a][r]);
+      free(outbuffer[a]);
+    }
+    free(outbuffer);
+  }
 
-  for(int a = 0; a < 3; a++)
-    for(int r = 0; r < in.nrows; r++)
-      free(outbuffer[a][r]);
+  PROF_ONLY(prof.wall = prof_time() - t0;)
+  PROF_ONLY(if(report != NULL) prof_report(report, in.nrows, in.ncols, radius, processes);)
 
   for(int a = 0; a < in.nbands; a++){
-    for(int r = 0; r < in.nrows; r++)
-      free(in.buffer[a][r]);
+    if(in.buffer != NULL)
+      free(in.buffer[a]);
     free(in.adfMinMax[a]);
   }
 
-  free(in.buffer); free(outbuffer); free(in.noData); free(in.hBand);
+  free(in.buffer); free(in.noData); free(in.hBand);
   free(in.adfMinMax);
 
   if(in.hDataset != NULL)
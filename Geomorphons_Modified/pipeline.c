@@ -0,0 +1,201 @@
+#include <pthread.h>
+#include <string.h>
+#include "utils.h"
+#include "geomorphons.h"
+#include "pipeline.h"
+#include "profile.h"
+
+typedef struct {
+  DATA *in;
+  GDALDatasetH out[3];
+  int bandRows;
+  int nbands;
+  int radius;
+  char *ring;               // row x of the input is held in ring row x % ringRows
+  int ringRows;
+  size_t rowBytes;
+  int *slot[PIPE_SLOTS];    // 3 layers of bandRows rows each
+  int rowsRead;             // rows [0, rowsRead) of the input have been read
+  int computed;             // bands computed
+  int written;              // bands written
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} PIPE;
+
+static void publish(PIPE *p, int *counter, int value){
+  pthread_mutex_lock(&p->lock);
+  *counter = value;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* Reads rows [r0, r0+n) into their ring rows, in two pieces at the wrap. */
+static void read_ring(PIPE *p, int r0, int n){
+  while(n > 0){
+    int at = r0 % p->ringRows;
+    int m = at + n <= p->ringRows ? n : p->ringRows - at;
+    readWindow(p->in, p->ring + (size_t)at * p->rowBytes, 0, r0, p->in->ncols, m);
+    r0 += m;
+    n -= m;
+  }
+}
+
+static void *reader(void *arg){
+  PIPE *p = (PIPE *) arg;
+
+  for(int r0 = 0; r0 < p->in->nrows; r0 += p->bandRows){
+    int n = r0 + p->bandRows < p->in->nrows ? p->bandRows : p->in->nrows - r0;
+
+    /* the rows overwritten, [r0, r0+n) less ringRows, must be above the halo
+       of the band being computed */
+    pthread_mutex_lock(&p->lock);
+    while(r0 + n > p->ringRows && r0 + n - p->ringRows > p->computed * p->bandRows - p->radius)
+      pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+
+    PROF_ONLY(double t = prof_time();)
+    read_ring(p, r0, n);
+    PROF_ONLY(prof.read += prof_time() - t;)
+
+    publish(p, &p->rowsRead, r0 + n);
+  }
+
+  return NULL;
+}
+
+static void *writer(void *arg){
+  PIPE *p = (PIPE *) arg;
+  int ncols = p->in->ncols;
+
+  for(int k = 0; k < p->nbands; k++){
+    pthread_mutex_lock(&p->lock);
+    while(p->computed <= k)
+      pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+
+    int r0 = k * p->bandRows;
+    int n = r0 + p->bandRows < p->in->nrows ? p->bandRows : p->in->nrows - r0;
+    int *slot = p->slot[k % PIPE_SLOTS];
+
+    PROF_ONLY(double t = prof_time();)
+    for(int a = 0; a < 3; a++)
+      writeRows(p->out[a], slot + (size_t)a * p->bandRows * ncols, r0, n, ncols, GDT_Int32);
+    PROF_ONLY(prof.write += prof_time() - t;)
+
+    publish(p, &p->written, k + 1);
+  }
+
+  return NULL;
+}
+
+void geomorphons_pipeline(DATA *in, char **output, int radius, int noData, int bandRows){
+
+  int nrows = in->nrows, ncols = in->ncols;
+
+  PIPE p;
+  p.in = in;
+  p.bandRows = bandRows < nrows ? bandRows : nrows;
+  p.nbands = (nrows + p.bandRows - 1) / p.bandRows;
+  p.radius = radius;
+  p.rowsRead = 0;
+  p.computed = 0;
+  p.written = 0;
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.cond, NULL);
+
+  /* The band being computed needs bandRows + 2 * radius rows; the reader
+     fills the next bandRows meanwhile. */
+  p.ringRows = 2 * (p.bandRows + radius) < nrows ? 2 * (p.bandRows + radius) : nrows;
+  p.rowBytes = elem_size(in->type) * ncols;
+  p.ring = (char *) malloc(p.rowBytes * p.ringRows);
+
+  /* a band whose rows wrap around the ring is computed on a copy */
+  int spanRows = p.bandRows + 2 * radius < nrows ? p.bandRows + 2 * radius : nrows;
+  char *span = (char *) malloc(p.rowBytes * spanRows);
+
+  size_t slotSize = (size_t)3 * p.bandRows * ncols;
+  for(int s = 0; s < PIPE_SLOTS; s++)
+    p.slot[s] = (int *) malloc(sizeof(int) * slotSize);
+
+  /* Row pointers of the three layers, relative to the first input row of
+     the band; the rows of band k point into its slot. */
+  int **rows[3];
+  int ok = p.ring != NULL && span != NULL;
+  for(int s = 0; s < PIPE_SLOTS; s++)
+    ok = ok && p.slot[s] != NULL;
+  for(int a = 0; a < 3; a++){
+    rows[a] = (int **) malloc(sizeof(int *) * spanRows);
+    ok = ok && rows[a] != NULL;
+  }
+
+  if(!ok){
+    printf("Not enough memory for the pipeline buffers.\n");
+    exit(-1);
+  }
+
+  for(int a = 0; a < 3; a++)
+    p.out[a] = createOutput(in->hDriver, output[a], nrows, ncols, noData, GDT_Int32, in->adfGeoTransform,
+        GDALGetProjectionRef(in->hDataset));
+
+  pthread_t hReader, hWriter;
+  pthread_create(&hReader, NULL, reader, &p);
+  pthread_create(&hWriter, NULL, writer, &p);
+
+  for(int k = 0; k < p.nbands; k++){
+    int r0 = k * p.bandRows;
+    int r1 = r0 + p.bandRows < nrows ? r0 + p.bandRows : nrows;
+    int lo = r0 - radius > 0 ? r0 - radius : 0;
+    int need = r1 + radius < nrows ? r1 + radius : nrows;
+
+    /* wait for the band and its halo, and for the slot to be written out */
+    pthread_mutex_lock(&p.lock);
+    while(p.rowsRead < need || p.written < k - PIPE_SLOTS + 1)
+      pthread_cond_wait(&p.cond, &p.lock);
+    pthread_mutex_unlock(&p.lock);
+
+    PROF_ONLY(double t = prof_time();)
+
+    int at = lo % p.ringRows, n = need - lo;
+    const char *block = p.ring + (size_t)at * p.rowBytes;
+    if(at + n > p.ringRows){
+      size_t head = (size_t)(p.ringRows - at) * p.rowBytes;
+      memcpy(span, block, head);
+      memcpy(span + head, p.ring, (size_t)n * p.rowBytes - head);
+      block = span;
+    }
+    GRID dem = dataGrid(in, block, n, ncols);
+
+    int *slot = p.slot[k % PIPE_SLOTS];
+    for(size_t i = 0; i < slotSize; i++)
+      slot[i] = noData;
+
+    for(int a = 0; a < 3; a++)
+      for(int r = r0; r < r1; r++)
+        rows[a][r - lo] = slot + ((size_t)a * p.bandRows + (r - r0)) * ncols;
+
+    int first = r0 < 1 ? 1 : r0;
+    int last = r1 > nrows - 1 ? nrows - 1 : r1;
+    if(first < last)
+      geomorphons_rows(&dem, rows, radius, in->adfGeoTransform[1], first - lo, last - lo, NULL);
+
+    PROF_ONLY(prof.compute += prof_time() - t;)
+
+    publish(&p, &p.computed, k + 1);
+  }
+
+  pthread_join(hReader, NULL);
+  pthread_join(hWriter, NULL);
+
+  for(int a = 0; a < 3; a++){
+    GDALClose(p.out[a]);
+    free(rows[a]);
+  }
+
+  for(int s = 0; s < PIPE_SLOTS; s++)
+    free(p.slot[s]);
+  free(span);
+  free(p.ring);
+
+  pthread_cond_destroy(&p.cond);
+  pthread_mutex_destroy(&p.lock);
+}
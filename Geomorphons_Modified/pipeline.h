@@ -0,0 +1,15 @@
+/* Pipelined execution of geomorphons().
+ *
+ * A reader thread reads the DEM in bands of rows into a ring of
+ * 2 * (bandRows + radius) input rows and publishes how many rows are
+ * available; it reuses rows only once the band being computed no longer
+ * needs them. The calling thread computes band k with the OpenMP kernel as
+ * soon as the rows of the band plus its halo of radius rows have arrived,
+ * into one of PIPE_SLOTS output slots. A writer thread writes finished slots
+ * to the three output rasters and hands them back. Reading, computing and writing therefore overlap, and only
+ * PIPE_SLOTS bands of output are held in memory. The radius must be given
+ * explicitly: with the whole DEM as radius, band 0 would wait for all of it. */
+
+#define PIPE_SLOTS 3
+
+void geomorphons_pipeline(DATA *, char **, int, int, int);  // input, outputs, radius, nodata, band rows
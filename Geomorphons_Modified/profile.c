@@ -0,0 +1,105 @@
+#ifdef PROFILE
+
+#include <time.h>
+#include "profile.h"
+
+PROFILE_DATA prof;
+
+double prof_time(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void add(COUNTERS *t, const COUNTERS *c){
+  t->cells += c->cells;
+  t->nodata += c->nodata;
+  t->nodataSamples += c->nodataSamples;
+  t->updates += c->updates;
+  for(int d = 0; d < 8; d++){
+    t->samples[d] += c->samples[d];
+    t->reach[d] += c->reach[d];
+  }
+}
+
+/* Threads beyond the table share its last slot, under a lock. */
+void prof_flush(COUNTERS *c){
+  int i = prof_thread();
+
+  if(i < PROF_MAX_THREADS - 1)
+    add(&prof.thread[i], c);
+  else{
+    # pragma omp critical (prof_overflow)
+    add(&prof.thread[PROF_MAX_THREADS - 1], c);
+  }
+}
+
+void prof_merge(PROFILE_DATA *worker){
+  for(int i = 0; i < worker->nthreads && prof.nthreads < PROF_MAX_THREADS; i++)
+    prof.thread[prof.nthreads++] = worker->thread[i];
+}
+
+static double mbs(double bytes, double seconds){
+  return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+void prof_report(const char *file, int nrows, int ncols, int radius, int processes){
+  FILE *fp = fopen(file, "w");
+  if(fp == NULL){
+    printf("Cannot write the profile report %s.\n", file);
+    return;
+  }
+
+  COUNTERS sum = {0};
+  for(int i = 0; i < prof.nthreads; i++){
+    COUNTERS *t = &prof.thread[i];
+    sum.cells += t->cells;
+    sum.nodata += t->nodata;
+    sum.nodataSamples += t->nodataSamples;
+    sum.updates += t->updates;
+    for(int d = 0; d < 8; d++){
+      sum.samples[d] += t->samples[d];
+      sum.reach[d] += t->reach[d];
+    }
+  }
+
+  long long reach = 0;
+  for(int d = 0; d < 8; d++)
+    reach += sum.reach[d];
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"tool\": \"geomorphons_modified\",\n");
+  fprintf(fp, "  \"rows\": %d,\n  \"cols\": %d,\n  \"radius\": %d,\n  \"processes\": %d,\n",
+      nrows, ncols, radius, processes);
+
+  fprintf(fp, "  \"phases\": {\"read\": %.6f, \"compute\": %.6f, \"write\": %.6f, \"wall\": %.6f},\n",
+      prof.read, prof.compute, prof.write, prof.wall);
+
+  fprintf(fp, "  \"io\": {\"bytes_read\": %.0f, \"bytes_written\": %.0f, \"read_mb_s\": %.3f, \"write_mb_s\": %.3f},\n",
+      prof.bytesRead, prof.bytesWritten, mbs(prof.bytesRead, prof.read), mbs(prof.bytesWritten, prof.write));
+
+  fprintf(fp, "  \"kernel\": {\n");
+  fprintf(fp, "    \"cells\": %lld,\n    \"nodata_cells\": %lld,\n    \"nodata_samples\": %lld,\n",
+      sum.cells, sum.nodata, sum.nodataSamples);
+  fprintf(fp, "    \"horizon_updates\": %lld,\n", sum.updates);
+  fprintf(fp, "    \"samples_per_direction\": [");
+  for(int d = 0; d < 8; d++)
+    fprintf(fp, "%s%lld", d ? ", " : "", sum.samples[d]);
+  fprintf(fp, "],\n    \"mean_scan_radius_per_direction\": [");
+  for(int d = 0; d < 8; d++)
+    fprintf(fp, "%s%.3f", d ? ", " : "", sum.cells ? (double)sum.reach[d] / sum.cells : 0);
+  fprintf(fp, "],\n    \"mean_scan_radius\": %.3f\n  },\n", sum.cells ? (double)reach / (8.0 * sum.cells) : 0);
+
+  fprintf(fp, "  \"threads\": [");
+  for(int i = 0; i < prof.nthreads; i++){
+    long long samples = 0;
+    for(int d = 0; d < 8; d++)
+      samples += prof.thread[i].samples[d];
+    fprintf(fp, "%s\n    {\"cells\": %lld, \"samples\": %lld}", i ? "," : "", prof.thread[i].cells, samples);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+
+  fclose(fp);
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* Hot-path instrumentation.
+ *
+ * Compiled in with -DPROFILE (make CFLAGS=-DPROFILE). Without it PROF_ONLY()
+ * expands to nothing, so the kernels carry no counters and no timers. */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define PROF_MAX_THREADS 256
+
+typedef struct {
+  long long cells;          // cells computed
+  long long nodata;         // nodata cells skipped
+  long long nodataSamples;  // nodata samples skipped along the scan lines
+  long long updates;        // horizon updates
+  long long samples[8];     // samples scanned per direction
+  long long reach[8];       // sum of the effective scan radius per direction
+} COUNTERS;
+
+typedef struct {
+  double read, compute, write;      // seconds per phase; busy time of each thread when pipelined
+  double wall;                      // elapsed seconds
+  double bytesRead, bytesWritten;
+  int nthreads;                     // at most PROF_MAX_THREADS; the last slot sums the threads beyond
+  COUNTERS thread[PROF_MAX_THREADS];
+} PROFILE_DATA;
+
+#ifdef PROFILE
+
+#define PROF_ONLY(...) __VA_ARGS__
+
+extern PROFILE_DATA prof;
+
+double prof_time(void);  // monotonic wall clock in seconds
+
+void prof_flush(COUNTERS *);  // adds the counters of a row to the calling thread
+
+void prof_merge(PROFILE_DATA *);  // appends the threads of a band worker
+
+void prof_report(const char *, int, int, int, int);  // JSON report: file, rows, cols, radius, processes
+
+#else
+
+#define PROF_ONLY(...)
+
+#endif
+
+static inline int prof_thread(void){
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+static inline int prof_threads(void){
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+#endif
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+#include "geomorphons.h"
+#include "incremental.h"
+#include "query.h"
+#include "evans.h"
+
+void query_init(QUERY *q, DATA *in, int radius, int noData){
+  q->in = in;
+  q->radius = radius;
+  q->noData = noData;
+  q->clock = 0;
+  for(int i = 0; i < QUERY_TILES; i++){
+    q->tile[i].tx = q->tile[i].ty = -1;
+    q->tile[i].used = 0;
+    q->tile[i].data = NULL;
+  }
+}
+
+void query_free(QUERY *q){
+  for(int i = 0; i < QUERY_TILES; i++)
+    free(q->tile[i].data);
+}
+
+/* Returns tile (tx, ty), reading it into the least recently used slot when
+   it is not cached. */
+static const char *get_tile(QUERY *q, int tx, int ty){
+  TILE *t = &q->tile[0];
+  for(int i = 0; i < QUERY_TILES; i++){
+    if(q->tile[i].tx == tx && q->tile[i].ty == ty){
+      q->tile[i].used = ++q->clock;
+      return (const char *) q->tile[i].data;
+    }
+    if(q->tile[i].used < t->used)
+      t = &q->tile[i];
+  }
+
+  if(t->data == NULL){
+    t->data = malloc(elem_size(q->in->type) * QUERY_TILE * QUERY_TILE);
+    if(t->data == NULL){
+      printf("Not enough memory for the tile cache.\n");
+      exit(-1);
+    }
+  }
+
+  int nx = q->in->ncols - tx * QUERY_TILE < QUERY_TILE ? q->in->ncols - tx * QUERY_TILE : QUERY_TILE;
+  int ny = q->in->nrows - ty * QUERY_TILE < QUERY_TILE ? q->in->nrows - ty * QUERY_TILE : QUERY_TILE;
+  readWindow(q->in, t->data, tx * QUERY_TILE, ty * QUERY_TILE, nx, ny);
+
+  t->tx = tx;
+  t->ty = ty;
+  t->used = ++q->clock;
+  return (const char *) t->data;
+}
+
+/* Copies a window of the DEM out of the tiles into a block of ny rows of
+   nx elements. */
+static void fetch(QUERY *q, char *block, int x0, int y0, int nx, int ny){
+  size_t elsize = elem_size(q->in->type);
+
+  for(int ty = y0 / QUERY_TILE; ty <= (y0 + ny - 1) / QUERY_TILE; ty++){
+    for(int tx = x0 / QUERY_TILE; tx <= (x0 + nx - 1) / QUERY_TILE; tx++){
+      const char *tile = get_tile(q, tx, ty);
+      int width = q->in->ncols - tx * QUERY_TILE < QUERY_TILE ? q->in->ncols - tx * QUERY_TILE : QUERY_TILE;
+
+      /* overlap of the tile and the window, in DEM cells */
+      int c0 = tx * QUERY_TILE > x0 ? tx * QUERY_TILE : x0;
+      int c1 = (tx + 1) * QUERY_TILE < x0 + nx ? (tx + 1) * QUERY_TILE : x0 + nx;
+      int r0 = ty * QUERY_TILE > y0 ? ty * QUERY_TILE : y0;
+      int r1 = (ty + 1) * QUERY_TILE < y0 + ny ? (ty + 1) * QUERY_TILE : y0 + ny;
+
+      for(int r = r0; r < r1; r++)
+        memcpy(block + elsize * ((size_t)(r - y0) * nx + (c0 - x0)),
+            tile + elsize * ((size_t)(r - ty * QUERY_TILE) * width + (c0 - tx * QUERY_TILE)), elsize * (c1 - c0));
+    }
+  }
+}
+
+/* The window must lie inside the DEM. As in a full run, cells on the edge
+   of the DEM get no result. */
+int query_window(QUERY *q, WINDOW w, CELL_RESULT *res){
+
+  DATA *in = q->in;
+  int nrows = in->nrows, ncols = in->ncols, radius = q->radius;
+  double cellsize = in->adfGeoTransform[1];
+  int halo = radius > 1 ? radius : 1;
+
+  /* cells with a result */
+  int r0 = w.y0 > 1 ? w.y0 : 1;
+  int r1 = w.y0 + w.ny < nrows - 1 ? w.y0 + w.ny : nrows - 1;
+  int c0 = w.x0 > 1 ? w.x0 : 1;
+  int c1 = w.x0 + w.nx < ncols - 1 ? w.x0 + w.nx : ncols - 1;
+
+  /* the DEM under their scan lines and 3x3 windows */
+  int lr0 = w.y0 - halo > 0 ? w.y0 - halo : 0;
+  int lr1 = w.y0 + w.ny + halo < nrows ? w.y0 + w.ny + halo : nrows;
+  int lc0 = w.x0 - halo > 0 ? w.x0 - halo : 0;
+  int lc1 = w.x0 + w.nx + halo < ncols ? w.x0 + w.nx + halo : ncols;
+  int lrows = lr1 - lr0, lcols = lc1 - lc0;
+
+  size_t elsize = elem_size(in->type);
+  char *block = (char *) malloc(elsize * lrows * lcols);
+  size_t layer = (size_t)w.ny * lcols;
+  int *geo = (int *) malloc(sizeof(int) * 3 * layer);
+  float *lsp = (float *) malloc(sizeof(float) * 5 * layer);
+  int **out[3];
+  if(block == NULL || geo == NULL || lsp == NULL){
+    printf("Not enough memory for a query window.\n");
+    exit(-1);
+  }
+
+  fetch(q, block, lc0, lr0, lcols, lrows);
+  GRID dem = dataGrid(in, block, lrows, lcols);
+
+  for(size_t k = 0; k < 3 * layer; k++)
+    geo[k] = q->noData;
+  for(size_t k = 0; k < 5 * layer; k++)
+    lsp[k] = q->noData;
+
+  for(int a = 0; a < 3; a++){
+    out[a] = (int **) malloc(sizeof(int *) * lrows);
+    for(int r = w.y0; r < w.y0 + w.ny; r++)
+      out[a][r - lr0] = geo + a * layer + (size_t)(r - w.y0) * lcols;
+  }
+
+  if(r0 < r1 && c0 < c1){
+    geomorphons_window(&dem, out, radius, cellsize, r0 - lr0, r1 - lr0, c0 - lc0, c1 - lc0, NULL);
+
+    for(int p = 0; p < 5; p++){
+      EVANS_KERNEL kernel = evans_select(p, in->type, in->policy);
+      for(int r = r0; r < r1; r++){
+        const char *mid = block + elsize * (size_t)(r - lr0) * lcols;
+        kernel(mid - elsize * lcols, mid, mid + elsize * lcols, lsp + p * layer + (size_t)(r - w.y0) * lcols,
+            c0 - lc0, c1 - lc0, cellsize, in->noData[0], q->noData);
+      }
+    }
+  }
+
+  int n = 0;
+  for(int r = w.y0; r < w.y0 + w.ny; r++){
+    for(int c = w.x0; c < w.x0 + w.nx; c++, n++){
+      size_t k = (size_t)(r - w.y0) * lcols + (c - lc0);
+      res[n].col = c;
+      res[n].row = r;
+      res[n].x = in->adfGeoTransform[0] + (c + 0.5) * in->adfGeoTransform[1];
+      res[n].y = in->adfGeoTransform[3] + (r + 0.5) * in->adfGeoTransform[5];
+      res[n].ternary = geo[k];
+      res[n].higher = geo[layer + k];
+      res[n].lower = geo[2 * layer + k];
+      for(int p = 0; p < 5; p++)  // NaN (NaN cells of a DEM with a nodata value) as the fill
+        res[n].evans[p] = lsp[p * layer + k] == lsp[p * layer + k] ? lsp[p * layer + k] : q->noData;
+    }
+  }
+
+  for(int a = 0; a < 3; a++)
+    free(out[a]);
+  free(lsp); free(geo); free(block);
+
+  return n;
+}
+
+/* Converts a query line to a window inside the DEM. Returns NULL, or the
+   reason the line has no answer. */
+static const char *parse(DATA *in, const char *line, WINDOW *w){
+  char kind[16];
+  double v[4];
+  double *gt = in->adfGeoTransform;
+  int n = sscanf(line, "%15s %lf %lf %lf %lf", kind, &v[0], &v[1], &v[2], &v[3]);
+  int c0, c1, r0, r1;
+
+  if(n == 3 && strcmp(kind, "point") == 0){
+    c0 = c1 = (int) floor((v[0] - gt[0]) / gt[1]);
+    r0 = r1 = (int) floor((v[1] - gt[3]) / gt[5]);
+  }
+  else if(n == 5 && strcmp(kind, "bbox") == 0){
+    c0 = (int) floor((v[0] - gt[0]) / gt[1]);
+    c1 = (int) floor((v[2] - gt[0]) / gt[1]);
+    r0 = (int) floor((v[3] - gt[3]) / gt[5]);  // the north edge comes first
+    r1 = (int) floor((v[1] - gt[3]) / gt[5]);
+  }
+  else if(n == 5 && strcmp(kind, "window") == 0){
+    if(v[2] < 1 || v[3] < 1)
+      return "empty window";
+    c0 = (int) v[0];
+    r0 = (int) v[1];
+    c1 = c0 + (int) v[2] - 1;
+    r1 = r0 + (int) v[3] - 1;
+  }
+  else
+    return "expected point X Y, bbox XMIN YMIN XMAX YMAX or window XOFF YOFF XSIZE YSIZE";
+
+  if(c0 > c1){ int s = c0; c0 = c1; c1 = s; }
+  if(r0 > r1){ int s = r0; r0 = r1; r1 = s; }
+  if(c0 < 0) c0 = 0;
+  if(r0 < 0) r0 = 0;
+  if(c1 > in->ncols - 1) c1 = in->ncols - 1;
+  if(r1 > in->nrows - 1) r1 = in->nrows - 1;
+
+  if(c0 > c1 || r0 > r1)
+    return "outside the DEM";
+  if((double)(c1 - c0 + 1) * (r1 - r0 + 1) > QUERY_MAX_CELLS)
+    return "window too large";
+
+  w->x0 = c0;
+  w->y0 = r0;
+  w->nx = c1 - c0 + 1;
+  w->ny = r1 - r0 + 1;
+  return NULL;
+}
+
+static const char *names[5] = { "slope", "profile", "tangential", "minimum", "maximum" };
+
+static void print_csv(int id, CELL_RESULT *res, int n){
+  for(int i = 0; i < n; i++){
+    printf("%d,%d,%d,%.6f,%.6f,%d,%d,%d", id, res[i].col, res[i].row, res[i].x, res[i].y,
+        res[i].ternary, res[i].higher, res[i].lower);
+    for(int p = 0; p < 5; p++)
+      printf(",%g", res[i].evans[p]);
+    printf("\n");
+  }
+  printf("\n");  // end of the answer
+}
+
+static void print_json(int id, CELL_RESULT *res, int n){
+  printf("{\"query\": %d, \"cells\": [", id);
+  for(int i = 0; i < n; i++){
+    printf("%s{\"col\": %d, \"row\": %d, \"x\": %.6f, \"y\": %.6f, \"ternary\": %d, \"higher\": %d, \"lower\": %d",
+        i > 0 ? ", " : "", res[i].col, res[i].row, res[i].x, res[i].y, res[i].ternary, res[i].higher, res[i].lower);
+    for(int p = 0; p < 5; p++)
+      printf(", \"%s\": %g", names[p], res[i].evans[p]);
+    printf("}");
+  }
+  printf("]}\n");
+}
+
+/* Answers the queries of fp, one per line, until its end or a line "quit".
+   Answers are numbered by the line of their query. A CSV answer is a block
+   of rows ended by an empty line; a JSON answer is one object per line. */
+void query_loop(QUERY *q, FILE *fp, int format){
+  char line[512];
+  int id = 0;
+  CELL_RESULT *res = (CELL_RESULT *) malloc(sizeof(CELL_RESULT) * QUERY_MAX_CELLS);
+  if(res == NULL){
+    printf("Not enough memory for the query results.\n");
+    exit(-1);
+  }
+
+  if(format == QUERY_CSV){
+    printf("query,col,row,x,y,ternary,higher,lower");
+    for(int p = 0; p < 5; p++)
+      printf(",%s", names[p]);
+    printf("\n");
+    fflush(stdout);
+  }
+
+  while(fgets(line, sizeof(line), fp) != NULL){
+    ++id;
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] == '\0' || line[0] == '#')
+      continue;
+    if(strcmp(line, "quit") == 0)
+      break;
+
+    WINDOW w;
+    const char *err = parse(q->in, line, &w);
+    if(err != NULL){
+      if(format == QUERY_JSON)
+        printf("{\"query\": %d, \"error\": \"%s\"}\n", id, err);
+      else
+        printf("# query %d: %s\n\n", id, err);
+    }
+    else{
+      int n = query_window(q, w, res);
+      if(format == QUERY_JSON)
+        print_json(id, res, n);
+      else
+        print_csv(id, res, n);
+    }
+    fflush(stdout);
+  }
+
+  free(res);
+}
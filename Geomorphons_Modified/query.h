@@ -0,0 +1,50 @@
+/* Terrain parameters of single cells or small windows, on demand.
+ *
+ * A query names a point or a bounding box in the coordinates of the DEM, or
+ * a window in cells. Only the window plus a halo of radius cells (at least
+ * one, for the Evans-Young kernels) is read, through a cache of square
+ * tiles of the DEM that stays warm across the queries of a session. The
+ * results equal those of a full run with the same radius.
+ *
+ * Queries, one per line (map coordinates in the units of the geotransform):
+ *   point X Y
+ *   bbox XMIN YMIN XMAX YMAX
+ *   window XOFF YOFF XSIZE YSIZE
+ * Each answer is written and flushed before the next line is read, so the
+ * loop can serve a client on stdin/stdout. Needs utils.h and incremental.h. */
+
+#define QUERY_TILE 256             // rows and columns of a cached tile
+#define QUERY_TILES 64             // tiles kept in memory
+#define QUERY_MAX_CELLS (1 << 20)  // largest window answered
+
+#define QUERY_CSV  0
+#define QUERY_JSON 1
+
+typedef struct {
+  int tx, ty;            // tile column and row, -1 if the slot is empty
+  unsigned long used;    // last use, for the eviction of the oldest tile
+  void *data;            // QUERY_TILE x QUERY_TILE elements, clipped at the DEM edge
+} TILE;
+
+typedef struct {
+  DATA *in;
+  int radius;
+  int noData;            // value of cells without a result
+  TILE tile[QUERY_TILES];
+  unsigned long clock;
+} QUERY;
+
+typedef struct {
+  int col, row;
+  double x, y;           // centre of the cell
+  int ternary, higher, lower;
+  float evans[5];        // slope, profile, tangential, minimum, maximum curvature
+} CELL_RESULT;
+
+void query_init(QUERY *, DATA *, int, int);  // dem, radius, nodata
+
+void query_free(QUERY *);
+
+int query_window(QUERY *, WINDOW, CELL_RESULT *);  // cells of the window into results, row by row
+
+void query_loop(QUERY *, FILE *, int);  // queries, format
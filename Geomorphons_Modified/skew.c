@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include "skew.h"
+
+#define SKEW_TILE 64
+
+/* Builds the copies when they pay off: the scan must be long enough and the
+   rows it spans must not fit in cache anyway, and the three copies must fit
+   in half of the memory that is currently available. builders processes
+   build copies of this size at the same time and share that memory. */
+int skew_policy(int mode, int nrows, int ncols, int radius, size_t elsize, int builders){
+
+  if(mode != SKEW_AUTO)
+    return mode == SKEW_ON;
+
+  if(radius < SKEW_MIN_RADIUS)
+    return 0;
+
+  int span = 2 * radius + 1 < nrows ? 2 * radius + 1 : nrows;
+  if((double)span * ncols * elsize <= SKEW_CACHE)
+    return 0;
+
+  double extra = 3.0 * nrows * ncols * elsize + 2.0 * (nrows + ncols) * sizeof(size_t);
+
+#ifdef _SC_AVPHYS_PAGES
+  double avail = (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+#else
+  double avail = (double)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+#endif
+
+  return avail > 0 && extra * builders <= avail / 2;
+}
+
+/* Copies the grid in tiles, so that the writes of a tile fall on
+   SKEW_TILE short runs of each copy instead of one cache line per cell. */
+#define SKEW_COPY(T) \
+  { \
+    const T *in = (const T *) g->data; \
+    T *t = (T *) s->t, *diag = (T *) s->diag, *anti = (T *) s->anti; \
+    _Pragma("omp parallel for schedule(dynamic)") \
+    for(int rt = 0; rt < nrows; rt += SKEW_TILE){ \
+      for(int ct = 0; ct < ncols; ct += SKEW_TILE){ \
+        int re = rt + SKEW_TILE < nrows ? rt + SKEW_TILE : nrows; \
+        int ce = ct + SKEW_TILE < ncols ? ct + SKEW_TILE : ncols; \
+        for(int c = ct; c < ce; c++){ \
+          for(int r = rt; r < re; r++){ \
+            T z = in[(size_t)r * ncols + c]; \
+            int kd = c - r + nrows - 1; \
+            int ka = r + c; \
+            int d0 = nrows - 1 - kd > 0 ? nrows - 1 - kd : 0; \
+            int a0 = ka - ncols + 1 > 0 ? ka - ncols + 1 : 0; \
+            t[(size_t)c * nrows + r] = z; \
+            diag[s->diagOff[kd] + (r - d0)] = z; \
+            anti[s->antiOff[ka] + (r - a0)] = z; \
+          } \
+        } \
+      } \
+    } \
+  }
+
+/* Returns NULL when the copies do not fit in memory; the caller then scans
+   the grid itself. */
+SKEW *skew_build(const GRID *g){
+
+  int nrows = g->nrows, ncols = g->ncols;
+  int nlines = nrows + ncols - 1;
+  size_t n = (size_t)nrows * ncols;
+  size_t elsize = elem_size(g->type);
+
+  SKEW *s = (SKEW *) malloc(sizeof(SKEW));
+  if(s == NULL)
+    return NULL;
+  s->nrows = nrows;
+  s->ncols = ncols;
+  s->t = malloc(elsize * n);
+  s->diag = malloc(elsize * n);
+  s->anti = malloc(elsize * n);
+  s->diagOff = (size_t *) malloc(sizeof(size_t) * (nlines + 1));
+  s->antiOff = (size_t *) malloc(sizeof(size_t) * (nlines + 1));
+
+  if(s->t == NULL || s->diag == NULL || s->anti == NULL || s->diagOff == NULL || s->antiOff == NULL){
+    skew_free(s);
+    return NULL;
+  }
+
+  /* Line lengths: diag line k holds rows max(0, nrows-1-k) .. min(nrows-1, nrows-1-k+ncols-1),
+     anti line k holds rows max(0, k-ncols+1) .. min(nrows-1, k). */
+  s->diagOff[0] = 0;
+  s->antiOff[0] = 0;
+  for(int k = 0; k < nlines; k++){
+    int d0 = nrows - 1 - k > 0 ? nrows - 1 - k : 0;
+    int d1 = nrows - 1 - k + ncols - 1 < nrows - 1 ? nrows - 1 - k + ncols - 1 : nrows - 1;
+    int a0 = k - ncols + 1 > 0 ? k - ncols + 1 : 0;
+    int a1 = k < nrows - 1 ? k : nrows - 1;
+    s->diagOff[k+1] = s->diagOff[k] + (d1 - d0 + 1);
+    s->antiOff[k+1] = s->antiOff[k] + (a1 - a0 + 1);
+  }
+
+  switch(elsize){
+    case sizeof(double): SKEW_COPY(double) break;
+    case sizeof(int16_t): SKEW_COPY(int16_t) break;
+    default: SKEW_COPY(float) break;
+  }
+
+  return s;
+}
+
+void skew_free(SKEW *s){
+  if(s == NULL)
+    return;
+
+  free(s->t); free(s->diag); free(s->anti);
+  free(s->diagOff); free(s->antiOff);
+  free(s);
+}
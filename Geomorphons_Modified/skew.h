@@ -0,0 +1,47 @@
+/* Direction-major copies of the DEM.
+ *
+ * In a row-major buffer only the two horizontal directions of geomorphons()
+ * scan at unit stride; the vertical and diagonal ones touch a new row, and a
+ * new cache line, at every step. The copies below store the DEM once per
+ * orientation so that every scan line is contiguous:
+ *
+ *   t     transposed, column c holds rows 0..nrows-1       d = 1, 5 (N, S)
+ *   diag  lines r - c = const (north-west to south-east)   d = 2, 6 (NW, SE)
+ *   anti  lines r + c = const (north-east to south-west)   d = 0, 4 (NE, SW)
+ *
+ * d is the direction index of nextr/nextc in geomorphons.h.
+ *
+ * Lines of diag and anti are packed one after the other; line k starts at
+ * diagOff[k] (antiOff[k]) and is indexed by the row of the cell minus the
+ * first row of the line. */
+
+#ifndef SKEW_H
+#define SKEW_H
+
+#include <stddef.h>
+#include "grid.h"
+
+#define SKEW_OFF  0
+#define SKEW_ON   1
+#define SKEW_AUTO 2
+
+#define SKEW_MIN_RADIUS 8         // shorter scans stay within a few cached rows
+#define SKEW_CACHE (8 << 20)      // bytes of rows the scan window may span and still stay in cache
+
+typedef struct {
+  int nrows;
+  int ncols;
+  void *t;           // copies hold elements of the type of the grid
+  void *diag;
+  void *anti;
+  size_t *diagOff;   // nrows + ncols - 1 lines, k = c - r + nrows - 1
+  size_t *antiOff;   // nrows + ncols - 1 lines, k = r + c
+} SKEW;
+
+int skew_policy(int, int, int, int, size_t, int);  // mode, rows, cols, radius, element size, builders
+
+SKEW *skew_build(const GRID *);  // NULL if out of memory
+
+void skew_free(SKEW *);
+
+#endif
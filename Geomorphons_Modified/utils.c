@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "profile.h"
 
 int ***malloc3Dmatrix(int bands, int rows, int cols, double nodata){
 
@@ -17,7 +18,8 @@ int ***malloc3Dmatrix(int bands, int rows, int cols, double nodata){
   return m;
 }
 
-DATA readRaster(char *input){
+/* Opens the DEM without allocating or reading its buffer. */
+DATA openRaster(char *input){
 
   DATA in;
 
@@ -50,6 +52,14 @@ DATA readRaster(char *input){
     exit(-1);
   }
 
+  /* Keep the data type of the band in memory when a kernel exists for it;
+     everything else is read as Float32 as before. */
+  switch(GDALGetRasterDataType(GDALGetRasterBand(in.hDataset, 1))){
+    case GDT_Float64: in.type = ELEM_FLOAT64; break;
+    case GDT_Byte: case GDT_Int16: in.type = ELEM_INT16; break;
+    default: in.type = ELEM_FLOAT32; break;
+  }
+
   in.hBand = (GDALRasterBandH *) malloc(sizeof(GDALRasterBandH) * in.nbands);
   in.noData = (double *) malloc(sizeof(double) * in.nbands);
   in.adfMinMax = (double **) malloc(sizeof(double *) * in.nbands);
@@ -66,6 +76,18 @@ DATA readRaster(char *input){
     if(!bGotNoValue)
       in.noData[b] = -32767;
 
+    if(b == 0){
+      if(!bGotNoValue)
+        in.policy = NODATA_NONE;
+      else if(in.noData[b] != in.noData[b])
+        in.policy = in.type == ELEM_INT16 ? NODATA_NONE : NODATA_NAN;
+      else if(in.type == ELEM_INT16 && (in.noData[b] < INT16_MIN || in.noData[b] > INT16_MAX
+              || in.noData[b] != (int) in.noData[b]))
+        in.policy = NODATA_NONE;  // no cell of the band can hold it
+      else
+        in.policy = NODATA_SENTINEL;
+    }
+
     int bGotMin, bGotMax;
     in.adfMinMax[b][0] = GDALGetRasterMinimum(in.hBand[b], &bGotMin);
     in.adfMinMax[b][1] = GDALGetRasterMaximum(in.hBand[b], &bGotMax);
@@ -75,44 +97,120 @@ DATA readRaster(char *input){
     //printf("Min=%.3f, Max=%.3f\n", in.adfMinMax[b][0], in.adfMinMax[b][1]);
   }
 
+  in.buffer = NULL;
 
-  in.buffer  = (float ***) malloc(sizeof(float **) * in.nbands);
-  for(int b = 0; b < in.nbands; b++){
-    in.buffer[b] = (float **) malloc(sizeof(float *) * in.nrows);
-    for(int r = 0; r < in.nrows; r++)
-      in.buffer[b][r] = (float *) malloc(sizeof(float) * in.ncols);
-    }
+  return in;
+}
+
+static GDALDataType gdalType(int type){
+  return type == ELEM_FLOAT64 ? GDT_Float64 : type == ELEM_INT16 ? GDT_Int16 : GDT_Float32;
+}
 
+void allocRaster(DATA *in){
 
-  for(int b = 0; b < in.nbands; b++){
-    for(int r = 0; r < in.nrows; r++){
-      CPLErr e = GDALRasterIO(in.hBand[b], GF_Read, 0, r, in.ncols, 1, in.buffer[b][r], in.ncols, 1,
-                  GDT_Float32, 0, 0);
+  size_t elsize = elem_size(in->type);
+
+  in->buffer = (void **) malloc(sizeof(void *) * in->nbands);
+  for(int b = 0; b < in->nbands; b++){
+    in->buffer[b] = malloc(elsize * in->nrows * in->ncols);  // one block, see geomorphons.h
+    if(in->buffer[b] == NULL){
+      printf("Not enough memory for the DEM.\n");
+      exit(-1);
+    }
+  }
+}
+
+/* Reads rows [r0, r0+n) of every band into the buffer. */
+void readRows(DATA *in, int r0, int n){
+  size_t elsize = elem_size(in->type);
+  for(int b = 0; b < in->nbands; b++){
+    char *rows = (char *) in->buffer[b] + elsize * r0 * in->ncols;
+    CPLErr e = GDALRasterIO(in->hBand[b], GF_Read, 0, r0, in->ncols, n, rows, in->ncols, n,
+                gdalType(in->type), 0, 0);
+    if(e != CE_None){
+      printf("Reading rows %d-%d failed: %s\n", r0, r0 + n - 1, CPLGetLastErrorMsg());
+      exit(-1);
     }
+    PROF_ONLY(prof.bytesRead += elsize * n * in->ncols;)
   }
+}
+
+/* Reads a window of the first band into a block of ny rows of nx elements. */
+void readWindow(DATA *in, void *block, int x0, int y0, int nx, int ny){
+  CPLErr e = GDALRasterIO(in->hBand[0], GF_Read, x0, y0, nx, ny, block, nx, ny, gdalType(in->type), 0, 0);
+  if(e != CE_None){
+    printf("Reading window %d %d %d %d failed: %s\n", x0, y0, nx, ny, CPLGetLastErrorMsg());
+    exit(-1);
+  }
+  PROF_ONLY(prof.bytesRead += elem_size(in->type) * nx * ny;)
+}
+
+/* Describes a block read from the first band to the kernels. */
+GRID dataGrid(DATA *in, const void *block, int nrows, int ncols){
+  GRID g = { block, in->type, in->policy, in->noData[0], nrows, ncols };
+  return g;
+}
+
+DATA readRaster(char *input){
+
+  DATA in = openRaster(input);
+
+  allocRaster(&in);
+  readRows(&in, 0, in.nrows);
 
   return in;
 }
 
-void writeOutput(GDALDriverH driver, char *out, int **buffer, int nrows, int ncols, int noData, int type, double *adfGeo, const char *proj){
+/* Creates a single band output raster with the georeferencing of the input. */
+GDALDatasetH createOutput(GDALDriverH driver, char *out, int nrows, int ncols, int noData, int type, double *adfGeo, const char *proj){
   GDALDatasetH hDstDS;
 
   char **papszOptions = NULL;
 
   hDstDS = GDALCreate(driver, out, ncols, nrows, 1, type, papszOptions);
 
-  GDALRasterBandH hBandOut = GDALGetRasterBand(hDstDS, 1);
-
-  for(int r = 0; r < nrows; r++){
-    CPLErr e = GDALRasterIO(hBandOut, GF_Write, 0, r, ncols, 1, buffer[r], ncols, 1,
-                      type, 0, 0);
-    }
+  if(hDstDS == NULL){
+    printf("Cannot create %s: %s\n", out, CPLGetLastErrorMsg());
+    exit(-1);
+  }
 
   GDALSetGeoTransform(hDstDS, adfGeo);
   GDALSetProjection(hDstDS, proj);
 
-  GDALSetRasterNoDataValue(hBandOut, noData);
+  GDALSetRasterNoDataValue(GDALGetRasterBand(hDstDS, 1), noData);
+
+  return hDstDS;
+}
+
+/* Writes n contiguous rows of ints starting at row r0. */
+void writeRows(GDALDatasetH hDstDS, int *rows, int r0, int n, int ncols, int type){
+  CPLErr e = GDALRasterIO(GDALGetRasterBand(hDstDS, 1), GF_Write, 0, r0, ncols, n, rows, ncols, n,
+                    type, 0, 0);
+  if(e != CE_None){
+    printf("Writing rows %d-%d failed: %s\n", r0, r0 + n - 1, CPLGetLastErrorMsg());
+    exit(-1);
+  }
+  PROF_ONLY(prof.bytesWritten += sizeof(int) * n * ncols;)
+}
+
+/* Writes a window of ny rows of nx ints; consecutive rows of the block are
+   lineSpace ints apart. */
+void writeWindow(GDALDatasetH hDstDS, int *block, int x0, int y0, int nx, int ny, int lineSpace, int type){
+  CPLErr e = GDALRasterIO(GDALGetRasterBand(hDstDS, 1), GF_Write, x0, y0, nx, ny, block, nx, ny,
+                    type, 0, lineSpace * (int)sizeof(int));
+  if(e != CE_None){
+    printf("Writing window %d %d %d %d failed: %s\n", x0, y0, nx, ny, CPLGetLastErrorMsg());
+    exit(-1);
+  }
+  PROF_ONLY(prof.bytesWritten += sizeof(int) * nx * ny;)
+}
+
+void writeOutput(GDALDriverH driver, char *out, int **buffer, int nrows, int ncols, int noData, int type, double *adfGeo, const char *proj){
+
+  GDALDatasetH hDstDS = createOutput(driver, out, nrows, ncols, noData, type, adfGeo, proj);
+
+  for(int r = 0; r < nrows; r++)
+    writeRows(hDstDS, buffer[r], r, 1, ncols, type);
 
-  if(hDstDS != NULL)
-    GDALClose(hDstDS);
+  GDALClose(hDstDS);
 }
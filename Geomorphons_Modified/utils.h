@@ -1,5 +1,6 @@
 #include "gdal.h"
 #include "cpl_error.h"
+#include "grid.h"
 
 typedef struct {
   GDALDatasetH hDataset;
@@ -18,11 +19,29 @@ typedef struct {
   */
   double *noData; // for each band
   double **adfMinMax; // for each band
-  float ***buffer;
+  int type;     // ELEM_* the buffer is read as, from the data type of the band
+  int policy;   // NODATA_* of the first band
+  void **buffer;  // for each band, one block of nrows * ncols elements of type
 } DATA;
 
 DATA readRaster(char *);  // read input file, char * input filename
 
+DATA openRaster(char *);  // as readRaster, without allocating and reading the buffer
+
+void allocRaster(DATA *);
+
+void readRows(DATA *, int, int);  // first row, number of rows
+
+void readWindow(DATA *, void *, int, int, int, int);  // block, x0, y0, nx, ny
+
+GRID dataGrid(DATA *, const void *, int, int);  // block of the first band, rows, cols
+
 void writeOutput(GDALDriverH, char *, int **, int, int, int, int, double *, const char *);
 
+GDALDatasetH createOutput(GDALDriverH, char *, int, int, int, int, double *, const char *);
+
+void writeRows(GDALDatasetH, int *, int, int, int, int);  // rows, first row, number of rows, cols, type
+
+void writeWindow(GDALDatasetH, int *, int, int, int, int, int, int);  // block, x0, y0, nx, ny, line space, type
+
 int ***malloc3Dmatrix(int, int, int, double);
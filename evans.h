@@ -0,0 +1,103 @@
+/*
+*
+* PURPOSE:      Evans - Young kernels specialised at compile time
+*
+*               evans_kernel.h is instantiated for float, double and int16
+*               DEMs and for each nodata policy, so the inner loop of a kernel
+*               holds neither a conversion it does not need nor a nodata test
+*               the DEM cannot fail. evans_select() picks the instantiation
+*               from the element type and the nodata policy of the DEM.
+*
+*               The arithmetic stays in double for every element type: the
+*               second derivatives are small differences of large sums and
+*               lose most of their digits in float.
+*
+*/
+
+#ifndef EVANS_H
+#define EVANS_H
+
+#include <math.h>
+#include <stdint.h>
+
+/* element types (ELEM_*) and nodata policies (NODATA_*), shared with the
+   geomorphons kernels */
+#include "Geomorphons_Modified/grid.h"
+
+/* parameters */
+#define EVANS_SLOPE         0
+#define EVANS_PROFILE       1
+#define EVANS_TANGENTIAL    2
+#define EVANS_MINIMUM       3
+#define EVANS_MAXIMUM       4
+
+/* up, mid and down are rows r-1, r and r+1 of the DEM, in its element type */
+typedef void (*EVANS_KERNEL)(const void *, const void *, const void *, float *, int, int,
+	double, double, double);  /* ..., out, c0, c1, cellsize, noData, fill */
+
+#define ELEM float
+#define REAL double
+#define POLICY NODATA_NONE
+#define NAME evans_f32_none
+#include "evans_kernel.h"
+
+#define ELEM float
+#define REAL double
+#define POLICY NODATA_SENTINEL
+#define NAME evans_f32_sentinel
+#include "evans_kernel.h"
+
+#define ELEM float
+#define REAL double
+#define POLICY NODATA_NAN
+#define NAME evans_f32_nan
+#include "evans_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_NONE
+#define NAME evans_f64_none
+#include "evans_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_SENTINEL
+#define NAME evans_f64_sentinel
+#include "evans_kernel.h"
+
+#define ELEM double
+#define REAL double
+#define POLICY NODATA_NAN
+#define NAME evans_f64_nan
+#include "evans_kernel.h"
+
+#define ELEM int16_t
+#define REAL double
+#define POLICY NODATA_NONE
+#define NAME evans_i16_none
+#include "evans_kernel.h"
+
+#define ELEM int16_t
+#define REAL double
+#define POLICY NODATA_SENTINEL
+#define NAME evans_i16_sentinel
+#include "evans_kernel.h"
+
+#define EVANS_ENTRY(name) { name##_slope, name##_profile, name##_tangential, name##_minimum, name##_maximum }
+
+/* Returns the kernel of a parameter for an element type and a nodata policy;
+   int16 DEMs have no NaN, so their NaN policy is the one without nodata. */
+static inline EVANS_KERNEL evans_select(int param, int type, int policy)
+{
+	static const EVANS_KERNEL kernels[3][3][5] = {
+		{ EVANS_ENTRY(evans_f32_none), EVANS_ENTRY(evans_f32_sentinel), EVANS_ENTRY(evans_f32_nan) },
+		{ EVANS_ENTRY(evans_f64_none), EVANS_ENTRY(evans_f64_sentinel), EVANS_ENTRY(evans_f64_nan) },
+		{ EVANS_ENTRY(evans_i16_none), EVANS_ENTRY(evans_i16_sentinel), EVANS_ENTRY(evans_i16_none) },
+	};
+
+	return kernels[type][policy][param];
+}
+
+#undef EVANS_ENTRY
+
+#endif
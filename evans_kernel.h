@@ -0,0 +1,104 @@
+/*
+*
+* PURPOSE:      Template of the Evans - Young kernels, see evans.h
+*
+*               evans.h includes this file once per instantiation, with
+*                 ELEM    element type of the DEM
+*                 REAL    type of the arithmetic
+*                 POLICY  NODATA_NONE, NODATA_SENTINEL or NODATA_NAN
+*                 NAME    prefix of the generated kernels
+*
+*               Each kernel computes the cells [c0, c1) of one row from the
+*               rows above (up), at (mid) and below (down). With NODATA_NONE
+*               the 3x3 window is used as read; with the other policies a
+*               window that holds a nodata cell (equal to noData, or NaN)
+*               gives fill, as do flat cells of the curvatures.
+*
+*/
+
+#define TPL_CAT2(a, b) a##_##b
+#define TPL_CAT(a, b) TPL_CAT2(a, b)
+#define TPL(x) TPL_CAT(NAME, x)
+
+#if POLICY == NODATA_NONE
+#define IS_DATA(z) 1
+#elif POLICY == NODATA_SENTINEL
+#define IS_DATA(z) ((z) != nd)
+#else
+#define IS_DATA(z) ((z) == (z))
+#endif
+
+/* Loads the 3x3 window of column c into flt and fits the quadratic surface:
+   d (P), e (Q), a (R), c (S) and b (T) of Evans. Returns 0 when the window
+   holds nodata. */
+static inline int TPL(fit)(const ELEM *up, const ELEM *mid, const ELEM *down, int c, ELEM nd,
+	REAL h6, REAL h3, REAL h4, REAL *P, REAL *Q, REAL *R, REAL *S, REAL *T)
+{
+	ELEM z[9] = { up[c-1], up[c], up[c+1], mid[c-1], mid[c], mid[c+1], down[c-1], down[c], down[c+1] };
+	REAL flt[9];
+	int k;
+
+	for(k = 0; k < 9; k++){
+		if(!IS_DATA(z[k]))
+			return 0;
+		flt[k] = (REAL) z[k];
+	}
+
+	*P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/h6;
+	*Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/h6;
+	*R=((flt[0]+flt[2]+flt[3]+flt[5]+flt[6]+flt[8])-2*(flt[1]+flt[4]+flt[7]))/h3;
+	*S=((flt[2]+flt[6])-(flt[0]+flt[8]))/h4;
+	*T=((flt[0]+flt[1]+flt[2]+flt[6]+flt[7]+flt[8])-2*(flt[3]+flt[4]+flt[5]))/h3;
+
+	return 1;
+}
+
+/* One kernel per parameter; BODY computes v from P, Q, R, S and T. */
+#define EVANS_ROW(param, BODY) \
+static void TPL(param)(const void *vup, const void *vmid, const void *vdown, float *out, int c0, int c1, \
+	double cellsize, double noData, double fill) \
+{ \
+	const ELEM *up = (const ELEM *) vup, *mid = (const ELEM *) vmid, *down = (const ELEM *) vdown; \
+	REAL h6 = 6 * (REAL) cellsize, h3 = 3 * (REAL) cellsize * (REAL) cellsize, h4 = 4 * (REAL) cellsize * (REAL) cellsize; \
+	REAL P, Q, R, S, T, v; \
+	ELEM nd = POLICY == NODATA_SENTINEL ? (ELEM) noData : 0; \
+	int c; \
+	(void) nd; \
+	for(c = c0; c < c1; c++){ \
+		if(!TPL(fit)(up, mid, down, c, nd, h6, h3, h4, &P, &Q, &R, &S, &T)){ \
+			out[c] = fill; \
+			continue; \
+		} \
+		BODY \
+		out[c] = v; \
+	} \
+}
+
+/* degrees */
+EVANS_ROW(slope, v = atan(sqrt((P*P) + (Q*Q))) * 57.295779513082323;)
+
+EVANS_ROW(profile,
+	if( P == 0.0 && Q == 0.0 )
+		v = fill;
+	else
+		v = -((P*P*R) + 2 * (P*Q*S) + (Q*Q*T)) / (((P*P)+(Q*Q)) * pow((1+(P*P)+(Q*Q)) , 1.5));)
+
+EVANS_ROW(tangential,
+	if( P == 0.0 && Q == 0.0 )
+		v = fill;
+	else
+		v = -((T*P*P)+(R*Q*Q)-2*(S*P*Q)) / (((Q*Q)+(P*P)) * sqrt(1+(P*P)+(Q*Q)));)
+
+EVANS_ROW(minimum, v = -R - T - sqrt(((R-T)*(R-T))+(S*S));)
+
+EVANS_ROW(maximum, v = -R - T + sqrt(((R-T)*(R-T))+(S*S));)
+
+#undef EVANS_ROW
+#undef IS_DATA
+#undef TPL
+#undef TPL_CAT
+#undef TPL_CAT2
+#undef ELEM
+#undef REAL
+#undef POLICY
+#undef NAME
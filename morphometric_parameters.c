@@ -2,6 +2,16 @@
 *
 * PURPOSE:      Calculation of land surface parameters with Evans - Young
 *
+*               Usage:        morphometric_parameters Input_DEM Output_LSP parameter [-u regions.txt] [report.json]
+*
+*               With -u, Output_LSP must hold the output of a previous run and
+*               Input_DEM the edited DEM. regions.txt lists the edited windows,
+*               one "xoff yoff xsize ysize" (in cells) per line; only the cells
+*               whose 3x3 window touches an edited window are recomputed.
+*
+*               The optional report (only with -DPROFILE) holds phase timings,
+*               I/O throughput and cell counts as JSON.
+*
 *               Available land surface parameters:
 *                1.  slope gradient (G) (in degrees)
 *                2.  profile (vertical) curvature (kv)(intersecting with the plane of the Z axis and aspect direction)
@@ -30,6 +40,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "evans.h"
 
 #define MAX_FILENAME    256 /* Filename length limit */
 
@@ -49,11 +60,10 @@ void error(const char *);
 void read_ascii(FILE *);
 void write_ascii(FILE *, float**);
 void show_progress(float);
-void slope_evans();
-void profc_evans();
-void tangc_evans();
-void minc_evans();
-void maxc_evans();
+void alloc_output(void);
+void read_output(FILE *);
+int nodata_policy(void);
+void evans(EVANS_KERNEL, int, int, int, int);
 
 /* ASCII Header */
 int ncols;               /* number of columns */
@@ -68,6 +78,17 @@ float **out_buffer;
 
 float prog;
 
+#ifdef PROFILE
+#include <time.h>
+
+double prof_read, prof_compute, prof_write;     /* seconds per phase */
+long prof_bytes_read, prof_bytes_written;
+long prof_cells;                                 /* cells computed */
+
+double prof_time(void);
+void prof_report(const char *, const char *);
+#endif
+
 int main(int argc, char **argv)
 {
     FILE *fpin;         /* elevation values file pointer */
@@ -79,8 +100,27 @@ int main(int argc, char **argv)
 	char outpathname[50];
 	char ch;
 
-    if(argc != 4)
-		error("Usage parameters: Input_DEM Output_LSP");
+	char *report = NULL;     /* JSON report */
+	char *dirty = NULL;      /* edited windows, update mode */
+	EVANS_KERNEL kernel;
+	int param, i;
+
+    if(argc < 4)
+		error("Usage parameters: Input_DEM Output_LSP parameter [-u regions.txt] [report.json]");
+
+	for(i = 4; i < argc; i++){
+		if(strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+			dirty = argv[++i];
+		else
+			report = argv[i];
+	}
+
+#ifdef PROFILE
+	double t = prof_time();
+#else
+	if(report != NULL)
+		printf("\n Built without -DPROFILE, no report is written.\n");
+#endif
 
 	/* Check of file type */
 	char *pdest = strrchr(argv[1],'.');  /* input */
@@ -112,30 +152,89 @@ int main(int argc, char **argv)
 			fclose(fpin1);
 		}
 		read_ascii(fpin);
+#ifdef PROFILE
+		prof_bytes_read = ftell(fpin);
+#endif
+		fclose(fpin);
 	}
 	else{
 		error("Wrong file format! Only ESRI ASCII and HDR files are accepted!");
 	}
 
 
+#ifdef PROFILE
+	prof_read = prof_time() - t;
+	t = prof_time();
+#endif
+
     if(strcmp(argv[3],"slope") == 0){
         printf(" Computation of slope\n");
-        slope_evans();}
+        param = EVANS_SLOPE;}
     else if (strcmp(argv[3],"profile") == 0){
         printf(" Computation of profile curvature\n");
-        profc_evans();}
+        param = EVANS_PROFILE;}
     else if(strcmp(argv[3],"tangential") == 0){
         printf(" Computation of tangential curvature\n");
-        tangc_evans();}
+        param = EVANS_TANGENTIAL;}
     else if(strcmp(argv[3],"minimum") == 0){
         printf(" Computation of minimum curvature\n");
-        minc_evans();}
+        param = EVANS_MINIMUM;}
     else if(strcmp(argv[3],"maximum") == 0){
         printf(" Computation of maximum curvature\n");
-        maxc_evans();}
-    else
+        param = EVANS_MAXIMUM;}
+    else{
         printf(" Menu: slope profile tangential minimum maximum ");
+        error("Unknown land surface parameter");}
 
+	/* the ASCII DEM is held as float */
+	kernel = evans_select(param, ELEM_FLOAT32, nodata_policy());
+
+	if(dirty == NULL){
+		alloc_output();
+		evans(kernel, 1, nrows-1, 1, ncols-1);
+#ifdef PROFILE
+		prof_cells = (long)(nrows - 2) * (ncols - 2);
+#endif
+	}
+	else{
+		/* Update mode: the previous output is read back and only the cells
+		   whose 3x3 window touches an edited window are recomputed. */
+		FILE *fpdirty, *fpprev;
+		char line[256];
+		int x0, y0, nx, ny;
+
+		fpprev = fopen(argv[2], "r");
+		if(fpprev == NULL)
+			error("The previous output doesn't exist!");
+		read_output(fpprev);
+		fclose(fpprev);
+
+		fpdirty = fopen(dirty, "r");
+		if(fpdirty == NULL)
+			error("The list of edited windows doesn't exist!");
+
+		/* one "xoff yoff xsize ysize" (in cells) per line */
+		while(fgets(line, sizeof(line), fpdirty) != NULL){
+			if(line[0] == '#' || sscanf(line, "%d %d %d %d", &x0, &y0, &nx, &ny) != 4 || nx <= 0 || ny <= 0)
+				continue;
+			int r0 = y0 - 1 > 1 ? y0 - 1 : 1;
+			int r1 = y0 + ny + 1 < nrows - 1 ? y0 + ny + 1 : nrows - 1;
+			int c0 = x0 - 1 > 1 ? x0 - 1 : 1;
+			int c1 = x0 + nx + 1 < ncols - 1 ? x0 + nx + 1 : ncols - 1;
+			if(r0 < r1 && c0 < c1){
+				evans(kernel, r0, r1, c0, c1);
+#ifdef PROFILE
+				prof_cells += (long)(r1 - r0) * (c1 - c0);
+#endif
+			}
+		}
+		fclose(fpdirty);
+	}
+
+#ifdef PROFILE
+	prof_compute = prof_time() - t;
+	t = prof_time();
+#endif
 
 	/* WRITE OUTPUT */
 
@@ -166,6 +265,12 @@ int main(int argc, char **argv)
 		}
 	}
 
+#ifdef PROFILE
+	prof_write = prof_time() - t;
+	if(report != NULL)
+		prof_report(report, argv[3]);
+#endif
+
 	return 0;
 }
 
@@ -194,7 +299,7 @@ void read_ascii(FILE *fp){
 	printf("\n nodata value = %lf\n", nodata_value);
 
 	/* Allocate memory of input two dimensional array */
-	in_buffer = malloc(sizeof(float) * nrows);
+	in_buffer = malloc(sizeof(float *) * nrows);
 	for(r = 0; r < nrows; r++){
 		in_buffer[r] = malloc(sizeof(float) * ncols);
 	}
@@ -229,9 +334,50 @@ void write_ascii(FILE *fp, float** out){
 		fprintf(fp, "\n");
 	}
 
+#ifdef PROFILE
+	prof_bytes_written = ftell(fp);
+#endif
+
 	fclose(fp);
 }
 
+void alloc_output(void){
+
+	int r, c;
+
+    /* Allocate memory of output two dimensional array */
+	out_buffer = malloc(sizeof(float *) * nrows);
+	for(r = 0; r < nrows; r++){
+		out_buffer[r] = malloc(sizeof(float) * ncols);
+	}
+
+	for(r = 0; r < nrows; r++)
+        for(c = 0; c < ncols; c++)
+            out_buffer[r][c] = nodata_value;
+}
+
+void read_output(FILE *fp){
+	char value[100];
+	int rows, cols, r, c;
+	double skip;
+
+	/* the header must match the one of the DEM */
+	fscanf(fp,"%s %d", value, &cols);
+    fscanf(fp,"%s %d", value, &rows);
+	for(r = 0; r < 4; r++)
+		fscanf(fp,"%s %lf", value, &skip);
+
+	if(rows != nrows || cols != ncols)
+		error("The previous output doesn't match the DEM");
+
+	alloc_output();
+
+	for(r = 0; r < nrows; r++)
+		for(c = 0; c < ncols; c++)
+			if(fscanf(fp, "%f", &out_buffer[r][c]) != 1)
+				error("The previous output is truncated");
+}
+
 void show_progress(float progress){
 
 int i, barWidth, pos;
@@ -256,231 +402,69 @@ if (progress <= 1.0) {
 }
 
 
-void slope_evans( )
+/* Cells equal to nodata_value are only tested for when the DEM holds
+   some; a NaN nodata_value marks NaN cells. */
+int nodata_policy(void)
 {
-	double P, Q, slope;
-	double flt[9];
 	int r, c;
 
-    /* Allocate memory of output two dimensional array */
-	out_buffer = malloc(sizeof(float) * nrows);
-	for(r = 0; r < nrows; r++){
-		out_buffer[r] = malloc(sizeof(float) * ncols);
-	}
+	if(nodata_value != nodata_value)
+		return NODATA_NAN;
 
 	for(r = 0; r < nrows; r++)
-        for(c = 0; c < ncols; c++)
-            out_buffer[r][c] = nodata_value;
-
-
-        for(r = 1; r < nrows-1; r++){
-            for(c = 1; c < ncols-1; c++){
-                flt[0]=in_buffer[r-1][c-1];
-                flt[1]=in_buffer[r-1][c];
-                flt[2]=in_buffer[r-1][c+1];
-                flt[3]=in_buffer[r][c-1];
-                flt[4]=in_buffer[r][c];
-                flt[5]=in_buffer[r][c+1];
-                flt[6]=in_buffer[r+1][c-1];
-                flt[7]=in_buffer[r+1][c];
-                flt[8]=in_buffer[r+1][c+1];
-
-                P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/(6*CellSize);
-                Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/(6*CellSize);
-
-                slope = sqrt((P*P) + (Q*Q));
-
-
-                /* degrees */
-                out_buffer[r][c] = atan(slope) * 57.295779513082323;
-
-            }
-            prog = (float)(r)/(float)(nrows-2);
-            show_progress(prog);
-        }
+		for(c = 0; c < ncols; c++)
+			if(in_buffer[r][c] == (float) nodata_value)
+				return NODATA_SENTINEL;
 
+	return NODATA_NONE;
 }
 
-void profc_evans()
+void evans(EVANS_KERNEL kernel, int r0, int r1, int c0, int c1)
 {
-	double P, Q, R, T, S, profc;
-	double flt[9];
-	int r, c;
-
-    /* Allocate memory of output two dimensional array */
-	out_buffer = malloc(sizeof(float) * nrows);
-	for(r = 0; r < nrows; r++){
-		out_buffer[r] = malloc(sizeof(float) * ncols);
-	}
-
-	for(r = 0; r < nrows; r++)
-        for(c = 0; c < ncols; c++)
-            out_buffer[r][c] = nodata_value;
-
+	int r;
 
-        for(r = 1; r < nrows-1; r++){
-            for(c = 1; c < ncols-1; c++){
-                flt[0]=in_buffer[r-1][c-1];
-                flt[1]=in_buffer[r-1][c];
-                flt[2]=in_buffer[r-1][c+1];
-                flt[3]=in_buffer[r][c-1];
-                flt[4]=in_buffer[r][c];
-                flt[5]=in_buffer[r][c+1];
-                flt[6]=in_buffer[r+1][c-1];
-                flt[7]=in_buffer[r+1][c];
-                flt[8]=in_buffer[r+1][c+1];
-
-       /*d */   P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/(6*CellSize);
-       /*e */   Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/(6*CellSize);
-       /*a */   R=((flt[0]+flt[2]+flt[3]+flt[5]+flt[6]+flt[8])-2*(flt[1]+flt[4]+flt[7]))/(3*CellSize*CellSize);
-       /*c */   S=((flt[2]+flt[6])-(flt[0]+flt[8]))/(4*CellSize*CellSize);
-       /*b */   T=((flt[0]+flt[1]+flt[2]+flt[6]+flt[7]+flt[8])-2*(flt[3]+flt[4]+flt[5]))/(3*CellSize*CellSize);
-
-                if( P == 0.0 && Q == 0.0 )
-                    profc = nodata_value;
-                else
-                    profc = -((P*P*R) + 2 * (P*Q*S) + (Q*Q*T)) / (((P*P)+(Q*Q)) * pow((1+(P*P)+(Q*Q)) , 1.5));
-
-                out_buffer[r][c] = profc;
-            }
-            prog = (float)(r)/(float)(nrows-2);
+        for(r = r0; r < r1; r++){
+            kernel(in_buffer[r-1], in_buffer[r], in_buffer[r+1], out_buffer[r], c0, c1, CellSize, nodata_value, nodata_value);
+            prog = (float)(r - r0 + 1)/(float)(r1 - r0);
             show_progress(prog);
         }
-
 }
 
 
-void tangc_evans()
+#ifdef PROFILE
+double prof_time(void)
 {
-	double P, Q, R, T, S, tangc;
-	double flt[9];
-	int r, c;
-
-    /* Allocate memory of output two dimensional array */
-	out_buffer = malloc(sizeof(float) * nrows);
-	for(r = 0; r < nrows; r++){
-		out_buffer[r] = malloc(sizeof(float) * ncols);
-	}
-
-	for(r = 0; r < nrows; r++)
-        for(c = 0; c < ncols; c++)
-            out_buffer[r][c] = nodata_value;
-
-        for(r = 1; r < nrows-1; r++){
-            for(c = 1; c < ncols-1; c++){
-                flt[0]=in_buffer[r-1][c-1];
-                flt[1]=in_buffer[r-1][c];
-                flt[2]=in_buffer[r-1][c+1];
-                flt[3]=in_buffer[r][c-1];
-                flt[4]=in_buffer[r][c];
-                flt[5]=in_buffer[r][c+1];
-                flt[6]=in_buffer[r+1][c-1];
-                flt[7]=in_buffer[r+1][c];
-                flt[8]=in_buffer[r+1][c+1];
-
-       /*d */   P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/(6*CellSize);
-       /*e */   Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/(6*CellSize);
-       /*a */   R=((flt[0]+flt[2]+flt[3]+flt[5]+flt[6]+flt[8])-2*(flt[1]+flt[4]+flt[7]))/(3*CellSize*CellSize);
-       /*c */   S=((flt[2]+flt[6])-(flt[0]+flt[8]))/(4*CellSize*CellSize);
-       /*b */   T=((flt[0]+flt[1]+flt[2]+flt[6]+flt[7]+flt[8])-2*(flt[3]+flt[4]+flt[5]))/(3*CellSize*CellSize);
-
-                if( P == 0.0 && Q == 0.0 )
-                    tangc = nodata_value;
-                else
-                    tangc = -((T*P*P)+(R*Q*Q)-2*(S*P*Q)) / (((Q*Q)+(P*P)) * sqrt(1+(P*P)+(Q*Q)));
-                out_buffer[r][c] = tangc;
-            }
-            prog = (float)(r)/(float)(nrows-2);
-            show_progress(prog);
-        }
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-void minc_evans()
+void prof_report(const char *file, const char *parameter)
 {
-	double P, Q, R, T, S, minc;
-	double flt[9];
-	int r, c;
+	FILE *fp = fopen(file, "w");
+	if(fp == NULL)
+		error("Cannot write the profile report");
+
+	double mb = 1024.0 * 1024.0;
+	long cells = prof_cells;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"tool\": \"morphometric_parameters\",\n");
+	fprintf(fp, "  \"parameter\": \"%s\",\n", parameter);
+	fprintf(fp, "  \"rows\": %d,\n  \"cols\": %d,\n", nrows, ncols);
+	fprintf(fp, "  \"phases\": {\"read\": %.6f, \"compute\": %.6f, \"write\": %.6f, \"total\": %.6f},\n",
+		prof_read, prof_compute, prof_write, prof_read + prof_compute + prof_write);
+	fprintf(fp, "  \"io\": {\"bytes_read\": %ld, \"bytes_written\": %ld, \"read_mb_s\": %.3f, \"write_mb_s\": %.3f},\n",
+		prof_bytes_read, prof_bytes_written,
+		prof_read > 0 ? prof_bytes_read / mb / prof_read : 0,
+		prof_write > 0 ? prof_bytes_written / mb / prof_write : 0);
+	fprintf(fp, "  \"kernel\": {\"cells\": %ld, \"cells_per_s\": %.0f},\n",
+		cells, prof_compute > 0 ? cells / prof_compute : 0);
+	fprintf(fp, "  \"threads\": [\n    {\"cells\": %ld}\n  ]\n}\n", cells);
 
-    /* Allocate memory of output two dimensional array */
-	out_buffer = malloc(sizeof(float) * nrows);
-	for(r = 0; r < nrows; r++){
-		out_buffer[r] = malloc(sizeof(float) * ncols);
-	}
-
-	for(r = 0; r < nrows; r++)
-        for(c = 0; c < ncols; c++)
-            out_buffer[r][c] = nodata_value;
-
-        for(r = 1; r < nrows-1; r++){
-            for(c = 1; c < ncols-1; c++){
-                flt[0]=in_buffer[r-1][c-1];
-                flt[1]=in_buffer[r-1][c];
-                flt[2]=in_buffer[r-1][c+1];
-                flt[3]=in_buffer[r][c-1];
-                flt[4]=in_buffer[r][c];
-                flt[5]=in_buffer[r][c+1];
-                flt[6]=in_buffer[r+1][c-1];
-                flt[7]=in_buffer[r+1][c];
-                flt[8]=in_buffer[r+1][c+1];
-
-       /*d */   P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/(6*CellSize);
-       /*e */   Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/(6*CellSize);
-       /*a */   R=((flt[0]+flt[2]+flt[3]+flt[5]+flt[6]+flt[8])-2*(flt[1]+flt[4]+flt[7]))/(3*CellSize*CellSize);
-       /*c */   S=((flt[2]+flt[6])-(flt[0]+flt[8]))/(4*CellSize*CellSize);
-       /*b */   T=((flt[0]+flt[1]+flt[2]+flt[6]+flt[7]+flt[8])-2*(flt[3]+flt[4]+flt[5]))/(3*CellSize*CellSize);
-
-                minc = -R - T - sqrt(((R-T)*(R-T))+(S*S));
-
-                out_buffer[r][c] = minc;
-            }
-            prog = (float)(r)/(float)(nrows-2);
-            show_progress(prog);
-        }
-}
-
-void maxc_evans()
-{
-	double P, Q, R, T, S, maxc;
-	double flt[9];
-	int r, c;
-
-    /* Allocate memory of output two dimensional array */
-	out_buffer = malloc(sizeof(float) * nrows);
-	for(r = 0; r < nrows; r++){
-		out_buffer[r] = malloc(sizeof(float) * ncols);
-	}
-
-	for(r = 0; r < nrows; r++)
-        for(c = 0; c < ncols; c++)
-            out_buffer[r][c] = nodata_value;
-
-        for(r = 1; r < nrows-1; r++){
-            for(c = 1; c < ncols-1; c++){
-                flt[0]=in_buffer[r-1][c-1];
-                flt[1]=in_buffer[r-1][c];
-                flt[2]=in_buffer[r-1][c+1];
-                flt[3]=in_buffer[r][c-1];
-                flt[4]=in_buffer[r][c];
-                flt[5]=in_buffer[r][c+1];
-                flt[6]=in_buffer[r+1][c-1];
-                flt[7]=in_buffer[r+1][c];
-                flt[8]=in_buffer[r+1][c+1];
-
-       /*d */   P=((flt[2]+flt[5]+flt[8])-(flt[0]+flt[3]+flt[6]))/(6*CellSize);
-       /*e */   Q=((flt[0]+flt[1]+flt[2])-(flt[6]+flt[7]+flt[8]))/(6*CellSize);
-       /*a */   R=((flt[0]+flt[2]+flt[3]+flt[5]+flt[6]+flt[8])-2*(flt[1]+flt[4]+flt[7]))/(3*CellSize*CellSize);
-       /*c */   S=((flt[2]+flt[6])-(flt[0]+flt[8]))/(4*CellSize*CellSize);
-       /*b */   T=((flt[0]+flt[1]+flt[2]+flt[6]+flt[7]+flt[8])-2*(flt[3]+flt[4]+flt[5]))/(3*CellSize*CellSize);
-
-                maxc = -R - T + sqrt(((R-T)*(R-T))+(S*S));
-
-                out_buffer[r][c] = maxc;
-            }
-            prog = (float)(r)/(float)(nrows-2);
-            show_progress(prog);
-        }
+	fclose(fp);
 }
-
+#endif
 
 void error(const char *s) {
     printf("\nSlope reports: Error: <%s>.\n",s);
@@ -0,0 +1,20 @@
+# Builds the terrain module in place:
+#   cd python && python3 setup.py build_ext --inplace
+# The kernels are compiled from the sources of the command line tools, so
+# the module needs neither GDAL nor NumPy to build; NumPy is imported at run
+# time to allocate results when no out buffer is given.
+
+from setuptools import setup, Extension
+
+terrain = Extension(
+    "terrain",
+    sources=["terrain.c",
+             "../Geomorphons_Modified/geomorphons.c",
+             "../Geomorphons_Modified/skew.c",
+             "../Geomorphons_Modified/profile.c"],
+    include_dirs=["../Geomorphons_Modified", ".."],
+    extra_compile_args=["-fopenmp"],
+    extra_link_args=["-fopenmp"],
+)
+
+setup(name="terrain", version="0.1", ext_modules=[terrain])
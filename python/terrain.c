@@ -0,0 +1,310 @@
+/* Python binding of the terrain kernels.
+ *
+ * geomorphons() and the Evans-Young kernels run on any C-contiguous 2-D
+ * buffer of float32, float64 or int16 (NumPy arrays, memoryviews, ...)
+ * without copying it. The results are written into NumPy arrays, or into
+ * caller supplied writable buffers passed as out, which must not overlap the
+ * DEM. The GIL is released while the kernels run; they use OpenMP as in the
+ * command line tools.
+ *
+ *   import numpy, terrain
+ *   t, h, l = terrain.geomorphons(dem, 10.0, radius=50, nodata=-9999)
+ *   slope = terrain.evans(dem, 10.0, "slope", nodata=-9999)
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include "geomorphons.h"
+#include "evans.h"
+
+/* Maps the struct format of a buffer to an element type, -1 if no kernel
+   exists for it. */
+static int elem_type(const char *format){
+  if(format == NULL)  // unsigned bytes
+    return -1;
+  if(*format == '@' || *format == '=')
+    ++format;
+  if(strcmp(format, "f") == 0)
+    return ELEM_FLOAT32;
+  if(strcmp(format, "d") == 0)
+    return ELEM_FLOAT64;
+  if(strcmp(format, "h") == 0)
+    return ELEM_INT16;
+  return -1;
+}
+
+/* Gets a C-contiguous 2-D buffer of a supported element type. */
+static int get_dem(PyObject *obj, Py_buffer *view, int *type){
+  if(PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+    return -1;
+
+  *type = elem_type(view->format);
+  if(view->ndim != 2 || *type < 0){
+    PyErr_SetString(PyExc_ValueError, "dem must be a 2-D array of float32, float64 or int16");
+    PyBuffer_Release(view);
+    return -1;
+  }
+  if(view->shape[0] < 3 || view->shape[1] < 3 || view->shape[0] > INT_MAX || view->shape[1] > INT_MAX){
+    PyErr_SetString(PyExc_ValueError, "dem must have at least 3 rows and 3 columns");
+    PyBuffer_Release(view);
+    return -1;
+  }
+  return 0;
+}
+
+/* Nodata policy of a DEM as in openRaster(): None gives no nodata, NaN gives
+   NaN cells, and a value an int16 DEM cannot hold gives no nodata. */
+static int get_policy(PyObject *nodata, int type, double *value){
+  *value = 0;
+  if(nodata == Py_None)
+    return NODATA_NONE;
+
+  *value = PyFloat_AsDouble(nodata);
+  if(*value == -1 && PyErr_Occurred())
+    return -1;
+
+  if(*value != *value)
+    return type == ELEM_INT16 ? NODATA_NONE : NODATA_NAN;
+  if(type == ELEM_INT16 && (*value < INT16_MIN || *value > INT16_MAX || *value != (int) *value))
+    return NODATA_NONE;
+  return NODATA_SENTINEL;
+}
+
+/* Returns out, checked to be a writable C-contiguous buffer of the given
+   format and shape, or a new NumPy array of that dtype and shape. */
+static PyObject *get_out(PyObject *out, const char *dtype, const char *format, int ndim, Py_ssize_t *shape,
+    Py_buffer *view){
+
+  PyObject *arr;
+  if(out == NULL || out == Py_None){
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if(numpy == NULL)
+      return NULL;
+    PyObject *dims = ndim == 3 ? Py_BuildValue("(nnn)", shape[0], shape[1], shape[2])
+                               : Py_BuildValue("(nn)", shape[0], shape[1]);
+    arr = dims == NULL ? NULL : PyObject_CallMethod(numpy, "empty", "Os", dims, dtype);
+    Py_XDECREF(dims);
+    Py_DECREF(numpy);
+    if(arr == NULL)
+      return NULL;
+  }
+  else{
+    arr = out;
+    Py_INCREF(arr);
+  }
+
+  if(PyObject_GetBuffer(arr, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) != 0){
+    Py_DECREF(arr);
+    return NULL;
+  }
+
+  const char *f = view->format;
+  if(*f == '@' || *f == '=')
+    ++f;
+  int ok = view->ndim == ndim && strcmp(f, format) == 0;
+  for(int k = 0; ok && k < ndim; k++)
+    ok = view->shape[k] == shape[k];
+
+  if(!ok){
+    PyErr_Format(PyExc_ValueError, "out must be a writable %s array of the shape of the result", dtype);
+    PyBuffer_Release(view);
+    Py_DECREF(arr);
+    return NULL;
+  }
+  return arr;
+}
+
+/* The kernels read neighbouring rows of dem after writing a row of out, so
+   the two must not share memory. Both buffers are contiguous. */
+static int shares_memory(const Py_buffer *a, const Py_buffer *b){
+  const char *a0 = (const char *) a->buf, *b0 = (const char *) b->buf;
+  if(a0 < b0 + b->len && b0 < a0 + a->len){
+    PyErr_SetString(PyExc_ValueError, "out must not overlap dem");
+    return 1;
+  }
+  return 0;
+}
+
+PyDoc_STRVAR(geomorphons_doc,
+"geomorphons(dem, cellsize, radius=0, nodata=None, skew='auto', fill=-9999, out=None)\n"
+"\n"
+"Ternary pattern, number of higher and number of lower directions of each\n"
+"cell of dem, as an int32 array of shape (3, rows, cols). radius is the\n"
+"scan radius in cells (0: the whole DEM). Cells equal to nodata (or NaN\n"
+"cells if nodata is NaN) are skipped; they and the border cells hold fill.\n"
+"cellsize does not change the result; it is taken for symmetry with evans().\n"
+"skew is 'on', 'off' or 'auto' as -s of geomorphons_modified; without\n"
+"memory for the skewed copies the DEM is scanned as with 'off'.");
+
+static PyObject *py_geomorphons(PyObject *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { "dem", "cellsize", "radius", "nodata", "skew", "fill", "out", NULL };
+  PyObject *demObj, *nodata = Py_None, *out = NULL;
+  double cellsize;
+  int radius = 0, fill = -9999;
+  const char *skewMode = "auto";
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "Od|iOsiO", kwlist, &demObj, &cellsize, &radius, &nodata,
+        &skewMode, &fill, &out))
+    return NULL;
+
+  int skew = strcmp(skewMode, "on") == 0 ? SKEW_ON : strcmp(skewMode, "off") == 0 ? SKEW_OFF :
+             strcmp(skewMode, "auto") == 0 ? SKEW_AUTO : -1;
+  if(skew < 0 || radius < 0){
+    PyErr_SetString(PyExc_ValueError, "radius must be >= 0 and skew one of 'on', 'off', 'auto'");
+    return NULL;
+  }
+
+  Py_buffer dem, res;
+  int type;
+  if(get_dem(demObj, &dem, &type) != 0)
+    return NULL;
+
+  GRID g = { dem.buf, type, 0, 0, (int) dem.shape[0], (int) dem.shape[1] };
+  g.policy = get_policy(nodata, type, &g.noData);
+  if(g.policy < 0){
+    PyBuffer_Release(&dem);
+    return NULL;
+  }
+
+  Py_ssize_t shape[3] = { 3, dem.shape[0], dem.shape[1] };
+  PyObject *result = get_out(out, "int32", "i", 3, shape, &res);
+  if(result == NULL){
+    PyBuffer_Release(&dem);
+    return NULL;
+  }
+  if(shares_memory(&dem, &res)){
+    PyBuffer_Release(&res); PyBuffer_Release(&dem);
+    Py_DECREF(result);
+    return NULL;
+  }
+
+  int nrows = g.nrows, ncols = g.ncols;
+  if(radius == 0 || radius > (nrows > ncols ? nrows : ncols))
+    radius = nrows > ncols ? nrows : ncols;
+
+  int *layers = (int *) res.buf;
+  int **rows = (int **) malloc(sizeof(int *) * 3 * nrows);
+  if(rows == NULL){
+    PyBuffer_Release(&res); PyBuffer_Release(&dem);
+    Py_DECREF(result);
+    return PyErr_NoMemory();
+  }
+
+  int **outRows[3];
+  for(int a = 0; a < 3; a++){
+    outRows[a] = rows + (size_t)a * nrows;
+    for(int r = 0; r < nrows; r++)
+      outRows[a][r] = layers + ((size_t)a * nrows + r) * ncols;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  for(size_t k = 0; k < (size_t)3 * nrows * ncols; k++)
+    layers[k] = fill;
+
+  SKEW *copies = NULL;
+  if(skew_policy(skew, nrows, ncols, radius, elem_size(type), 1))
+    copies = skew_build(&g);
+
+  geomorphons_rows(&g, outRows, radius, cellsize, 1, nrows - 1, copies);
+
+  skew_free(copies);
+  Py_END_ALLOW_THREADS
+
+  free(rows);
+  PyBuffer_Release(&res);
+  PyBuffer_Release(&dem);
+  return result;
+}
+
+PyDoc_STRVAR(evans_doc,
+"evans(dem, cellsize, parameter, nodata=None, out=None)\n"
+"\n"
+"Evans-Young land surface parameter of each cell of dem as a float32 array\n"
+"of the shape of dem. parameter is one of 'slope' (degrees), 'profile',\n"
+"'tangential', 'minimum' or 'maximum' as in morphometric_parameters. Cells\n"
+"whose 3x3 window holds nodata, and the border cells, hold nodata (NaN if\n"
+"nodata is None).");
+
+static PyObject *py_evans(PyObject *self, PyObject *args, PyObject *kwds){
+  static char *kwlist[] = { "dem", "cellsize", "parameter", "nodata", "out", NULL };
+  static const char *names[] = { "slope", "profile", "tangential", "minimum", "maximum" };
+  PyObject *demObj, *nodata = Py_None, *out = NULL;
+  double cellsize, noData;
+  const char *name;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwds, "Ods|OO", kwlist, &demObj, &cellsize, &name, &nodata, &out))
+    return NULL;
+
+  int param = -1;
+  for(int k = 0; k < 5; k++)
+    if(strcmp(name, names[k]) == 0)
+      param = k;
+  if(param < 0){
+    PyErr_SetString(PyExc_ValueError, "parameter must be slope, profile, tangential, minimum or maximum");
+    return NULL;
+  }
+
+  Py_buffer dem, res;
+  int type;
+  if(get_dem(demObj, &dem, &type) != 0)
+    return NULL;
+
+  int policy = get_policy(nodata, type, &noData);
+  if(policy < 0){
+    PyBuffer_Release(&dem);
+    return NULL;
+  }
+  if(nodata == Py_None)
+    noData = NAN;
+
+  PyObject *result = get_out(out, "float32", "f", 2, dem.shape, &res);
+  if(result == NULL){
+    PyBuffer_Release(&dem);
+    return NULL;
+  }
+  if(shares_memory(&dem, &res)){
+    PyBuffer_Release(&res); PyBuffer_Release(&dem);
+    Py_DECREF(result);
+    return NULL;
+  }
+
+  EVANS_KERNEL kernel = evans_select(param, type, policy);
+  int nrows = (int) dem.shape[0], ncols = (int) dem.shape[1];
+  size_t rowBytes = elem_size(type) * ncols;
+  const char *in = (const char *) dem.buf;
+  float *o = (float *) res.buf;
+
+  Py_BEGIN_ALLOW_THREADS
+  for(int c = 0; c < ncols; c++){
+    o[c] = noData;
+    o[(size_t)(nrows - 1) * ncols + c] = noData;
+  }
+
+  # pragma omp parallel for
+  for(int r = 1; r < nrows - 1; r++){
+    float *row = o + (size_t)r * ncols;
+    row[0] = row[ncols - 1] = noData;
+    kernel(in + (r - 1) * rowBytes, in + r * rowBytes, in + (r + 1) * rowBytes, row, 1, ncols - 1,
+        cellsize, noData, noData);
+  }
+  Py_END_ALLOW_THREADS
+
+  PyBuffer_Release(&res);
+  PyBuffer_Release(&dem);
+  return result;
+}
+
+static PyMethodDef methods[] = {
+  { "geomorphons", (PyCFunction)(void (*)(void)) py_geomorphons, METH_VARARGS | METH_KEYWORDS, geomorphons_doc },
+  { "evans", (PyCFunction)(void (*)(void)) py_evans, METH_VARARGS | METH_KEYWORDS, evans_doc },
+  { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "terrain", "Geomorphons and Evans-Young kernels on in-memory DEMs.", -1, methods
+};
+
+PyMODINIT_FUNC PyInit_terrain(void){
+  return PyModule_Create(&module);
+}